@@ -32,4 +32,33 @@ class FrequencyLogger {
     unsigned long tickCount;
 };
 
+// Prints a running count, e.g. of dropped frames, at most once per
+// printIntervalMs and only when it has changed, so something that can happen
+// hundreds of times a second doesn't flood the serial.
+class CountLogger {
+   public:
+    CountLogger(String label, unsigned long printIntervalMs)
+        : label(label),
+          printIntervalMs(printIntervalMs),
+          lastPrintTime(millis()),
+          lastCount(0) {}
+
+    void tick(uint32_t count) {
+        if (count != lastCount && millis() - lastPrintTime > printIntervalMs) {
+            Serial.print("[");
+            Serial.print(label);
+            Serial.print("] ");
+            Serial.println(count);
+            lastPrintTime = millis();
+            lastCount = count;
+        }
+    }
+
+   private:
+    String label;
+    unsigned long printIntervalMs;
+    unsigned long lastPrintTime;
+    uint32_t lastCount;
+};
+
 #endif  // FREQUENCY_LOGGER_H_
@@ -0,0 +1,160 @@
+#ifndef FILTERS_H_
+#define FILTERS_H_
+
+#include <stdint.h>
+
+#include <type_traits>
+
+#include "utils.h"
+
+// Streaming filters that can be chained with FilterChain. Each stage has
+//
+//   bool process(T in, T& out);  // false if `in` produced no output
+//   void reset(T value);         // as if every input so far was `value`
+//
+// and is fixed size, so nothing is allocated. They work on floats, but are
+// meant for fixed-point integers (e.g. counts or milli-psi), where they only
+// use integer adds and shifts; `Sum` is the wider type used for sums and
+// differences so those can't overflow, and must be wider than an integer `T`.
+//
+// e.g. median of 3 to drop spikes, then a 4 sample average to anti-alias,
+// then keeping every 4th sample:
+//
+//   FilterChain<int32_t, MedianFilter<int32_t, 3>,
+//               MovingAverageFilter<int32_t, 4, int64_t>,
+//               DecimationFilter<int32_t, 4>>
+//       filter;
+namespace filters {
+
+template <typename T, int WindowSize>
+class MedianFilter {
+   public:
+    MedianFilter() : median(0) {}
+
+    bool process(T in, T& out) {
+        median.add(in);
+        out = median.getMedian();
+        return true;
+    }
+
+    void reset(T value) { median.reset(value); }
+
+   private:
+    utils::MovingMedian<T, WindowSize> median;
+};
+
+// FIR low-pass with `Length` equal taps. A power of two length makes the
+// division a shift.
+template <typename T, int Length, typename Sum>
+class MovingAverageFilter {
+    static_assert(Length > 0, "Length must be positive");
+    static_assert(!std::is_integral<T>::value || sizeof(Sum) > sizeof(T),
+                  "Sum must be wider than T");
+
+   public:
+    MovingAverageFilter() { reset(0); }
+
+    bool process(T in, T& out) {
+        sum += (Sum)in - values[next];
+        values[next] = in;
+        next = next + 1 < Length ? next + 1 : 0;
+        out = sum / Length;
+        return true;
+    }
+
+    void reset(T value) {
+        for (int i = 0; i < Length; i++) {
+            values[i] = value;
+        }
+        sum = (Sum)value * Length;
+        next = 0;
+    }
+
+   private:
+    T values[Length];
+    Sum sum;
+    int next;  // oldest value
+};
+
+// First order IIR low-pass, y += (x - y) / 2^Shift, with a time constant of
+// about 2^Shift samples.
+template <typename T, int Shift, typename Sum>
+class ExponentialAverageFilter {
+    static_assert(Shift >= 0 && Shift < 16, "Shift must be in [0, 16)");
+    static_assert(!std::is_integral<T>::value || sizeof(Sum) > sizeof(T),
+                  "Sum must be wider than T");
+
+   public:
+    ExponentialAverageFilter() { reset(0); }
+
+    bool process(T in, T& out) {
+        // kept scaled up by 2^Shift so the fraction isn't lost each step
+        state += (Sum)in - state / (1 << Shift);
+        out = state / (1 << Shift);
+        return true;
+    }
+
+    void reset(T value) { state = (Sum)value * (1 << Shift); }
+
+   private:
+    Sum state;
+};
+
+// Outputs every `Factor`th input. Put a low-pass of at least `Factor` samples
+// in front of it, or the dropped samples alias into the kept ones.
+template <typename T, int Factor>
+class DecimationFilter {
+    static_assert(Factor > 0, "Factor must be positive");
+
+   public:
+    bool process(T in, T& out) {
+        if (++count < Factor) {
+            return false;
+        }
+        count = 0;
+        out = in;
+        return true;
+    }
+
+    void reset(T) { count = 0; }
+
+   private:
+    int count = 0;
+};
+
+// Runs `Stages` in order, stopping at the first one that produces no output.
+template <typename T, typename... Stages>
+class FilterChain;
+
+template <typename T>
+class FilterChain<T> {
+   public:
+    bool process(T in, T& out) {
+        out = in;
+        return true;
+    }
+
+    void reset(T) {}
+};
+
+template <typename T, typename First, typename... Rest>
+class FilterChain<T, First, Rest...> {
+   public:
+    bool process(T in, T& out) {
+        T firstOut;
+        return first.process(in, firstOut) && rest.process(firstOut, out);
+    }
+
+    void reset(T value) {
+        first.reset(value);
+        rest.reset(value);
+    }
+
+   private:
+    First first;
+    FilterChain<T, Rest...> rest;
+};
+
+}  // namespace filters
+
+#endif  // FILTERS_H_
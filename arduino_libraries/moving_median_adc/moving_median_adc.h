@@ -3,6 +3,9 @@
 
 #include <Adafruit_ADS1X15.h>
 
+#include <array>
+
+#include "sample_queue.h"
 #include "utils.h"
 
 enum class ADCMode {
@@ -14,70 +17,241 @@ enum class ADCMode {
     Differential_2_3
 };
 
+// value of the MUX field of the ADS1x15 config register for `mode`
+inline uint16_t adcModeMux(ADCMode mode) {
+    switch (mode) {
+        case ADCMode::SingleEnded_0:
+            return ADS1X15_REG_CONFIG_MUX_SINGLE_0;
+        case ADCMode::SingleEnded_1:
+            return ADS1X15_REG_CONFIG_MUX_SINGLE_1;
+        case ADCMode::SingleEnded_2:
+            return ADS1X15_REG_CONFIG_MUX_SINGLE_2;
+        case ADCMode::SingleEnded_3:
+            return ADS1X15_REG_CONFIG_MUX_SINGLE_3;
+        case ADCMode::Differential_0_1:
+            return ADS1X15_REG_CONFIG_MUX_DIFF_0_1;
+        case ADCMode::Differential_2_3:
+            return ADS1X15_REG_CONFIG_MUX_DIFF_2_3;
+    }
+    return ADS1X15_REG_CONFIG_MUX_SINGLE_0;
+}
+
+// conversions per second at the data rate `adc` is set to
+inline int adcConversionsPerSecond(Adafruit_ADS1015& adc) {
+    switch (adc.getDataRate()) {
+        case RATE_ADS1015_128SPS:
+            return 128;
+        case RATE_ADS1015_250SPS:
+            return 250;
+        case RATE_ADS1015_490SPS:
+            return 490;
+        case RATE_ADS1015_920SPS:
+            return 920;
+        case RATE_ADS1015_1600SPS:
+            return 1600;
+        case RATE_ADS1015_2400SPS:
+            return 2400;
+        case RATE_ADS1015_3300SPS:
+            return 3300;
+    }
+    return 3300;
+}
+
+inline int adcConversionsPerSecond(Adafruit_ADS1115& adc) {
+    switch (adc.getDataRate()) {
+        case RATE_ADS1115_8SPS:
+            return 8;
+        case RATE_ADS1115_16SPS:
+            return 16;
+        case RATE_ADS1115_32SPS:
+            return 32;
+        case RATE_ADS1115_64SPS:
+            return 64;
+        case RATE_ADS1115_128SPS:
+            return 128;
+        case RATE_ADS1115_250SPS:
+            return 250;
+        case RATE_ADS1115_475SPS:
+            return 475;
+        case RATE_ADS1115_860SPS:
+            return 860;
+    }
+    return 860;
+}
+
+// a reading, with the time it was taken
+struct ADCSample {
+    // esp_timer_get_time() at the end of the conversion if the ready
+    // interrupt is enabled, otherwise when the conversion was read
+    int64_t ts;
+    int32_t counts;  // relative to the zero at the time
+    // the first queued reading since the zero changed, so e.g. filters
+    // holding readings relative to the old zero should be reset
+    bool zeroChanged;
+};
+
+// Converts ADC counts to an integer unit such as milli-psi with a 16.16
+// fixed-point scale, so no floats are needed per reading. Results round
+// down. Good for up to 32767 units per count.
+class CountsScale {
+   public:
+    CountsScale() : unitsPerCountQ16(0) {}
+
+    explicit CountsScale(float unitsPerCount)
+        : unitsPerCountQ16(lroundf(unitsPerCount * 65536)) {}
+
+    int32_t toUnits(int32_t counts) const {
+        return ((int64_t)counts * unitsPerCountQ16) >> 16;
+    }
+
+   private:
+    int32_t unitsPerCountQ16;
+};
+
+const int ADC_SAMPLE_QUEUE_CAPACITY = 32;
+
 // if continuous is true, the ADC must only be used for one channel
-template <typename ADCType>
+// the median window and the number of readings used to recalibrate are fixed
+// at compile time, so nothing is heap allocated
+// readings, the zero and the median are all kept in ADC counts; volts are
+// only used to load and save the zero, and getting a reading in the
+// transducer's unit is a fixed-point multiply, see setUnitsPerVolt()
+template <typename ADCType, int WindowSize, int CalibrationSampleCount>
 class MovingMedianADC {
    public:
-    MovingMedianADC(const char* debugName, int windowSize, ADCType& adc,
-                    ADCMode mode)
-        : debugName(debugName),
-          adc(adc),
-          mode(mode),
-          medianVolts(windowSize, 0) {}
+    MovingMedianADC(const char* debugName, ADCType& adc, ADCMode mode)
+        : debugName(debugName), adc(adc), mode(mode), medianCounts(0) {}
 
-    void enableContinuous() {
-        uint16_t mux;
-
-        switch (mode) {
-            case ADCMode::SingleEnded_0:
-                mux = ADS1X15_REG_CONFIG_MUX_SINGLE_0;
-                break;
-            case ADCMode::SingleEnded_1:
-                mux = ADS1X15_REG_CONFIG_MUX_SINGLE_1;
-                break;
-            case ADCMode::SingleEnded_2:
-                mux = ADS1X15_REG_CONFIG_MUX_SINGLE_2;
-                break;
-            case ADCMode::SingleEnded_3:
-                mux = ADS1X15_REG_CONFIG_MUX_SINGLE_3;
-                break;
-            case ADCMode::Differential_0_1:
-                mux = ADS1X15_REG_CONFIG_MUX_DIFF_0_1;
-                break;
-            case ADCMode::Differential_2_3:
-                mux = ADS1X15_REG_CONFIG_MUX_DIFF_2_3;
-                break;
-        }
+    ADCMode getMode() const { return mode; }
+
+    // Sets the scale used by toUnits(), e.g. milli-psi per volt. Must be
+    // called after adc.setGain().
+    void setUnitsPerVolt(float unitsPerVolt) {
+        scale = CountsScale(unitsPerVolt * adc.computeVolts(1));
+    }
+
+    // `counts` relative to the zero, e.g. from a sample, in the unit set by
+    // setUnitsPerVolt()
+    int32_t toUnits(int32_t counts) const { return scale.toUnits(counts); }
 
-        adc.startADCReading(mux, true);
+    // Must be called after adc.setDataRate().
+    void enableContinuous() {
+        adc.startADCReading(adcModeMux(mode), true);
         continuous = true;
+        conversionPeriodUs = 1000000 / adcConversionsPerSecond(adc);
+        nextPollTs = esp_timer_get_time() + conversionPeriodUs;
     }
 
-    // returns new zero volts
-    float recalibrate(int sampleCount) {
-        std::vector<float> samples;
-        for (int i = 0; i < sampleCount; i++) {
-            samples.push_back(readVolts());
-        }
-        float newZeroVolts = utils::median(samples);
-        setZero(newZeroVolts);
-        return newZeroVolts;
+    // Optional, after enableContinuous(). The ADC pulses its ALERT/RDY pin at
+    // the end of every continuous conversion; with that pin wired to `pin`,
+    // an interrupt timestamps each conversion, and tick() only reads the ADC
+    // when there is a new one. Otherwise tick() reads the last conversion
+    // once per conversion period at the data rate, so each reading is taken
+    // about once; the ADC's clock is only accurate to a few percent, so a
+    // reading is now and then repeated or skipped.
+    void enableReadyInterrupt(int pin) {
+        readyPin = pin;
+        pinMode(pin, INPUT_PULLUP);  // ALERT/RDY is open drain
+        attachInterruptArg(digitalPinToInterrupt(pin), onReady, this,
+                           FALLING);
     }
 
-    void resetZero() { setZero(0); }
+    // Queues every reading tick() takes, for popSample().
+    void enableSampleQueue() { queueSamples = true; }
 
+    // Returns false if there is no queued reading.
+    bool popSample(ADCSample& sample) { return samples.pop(sample); }
+
+    // Like popSample(), but leaves the reading queued.
+    bool peekSample(ADCSample& sample) { return samples.peek(sample); }
+
+    // conversions that finished before the previous one was read, with the
+    // ready interrupt enabled
+    uint32_t getMissedConversionCount() const { return missedConversions; }
+
+    // readings dropped because the sample queue was full
+    uint32_t getDroppedSampleCount() const { return droppedSamples; }
+
+    // Starts collecting readings from tick() for a new zero, which is set to
+    // their median once CalibrationSampleCount of them are in. Readings are
+    // reported against the old zero until then. Restarts any recalibration
+    // in progress.
+    void startRecalibration() {
+        calibrationSampleIndex = 0;
+        recalibrating = true;
+    }
+
+    bool isRecalibrating() const { return recalibrating; }
+
+    // also cancels any recalibration in progress
+    void resetZero() {
+        recalibrating = false;
+        setZeroCounts(0);
+    }
+
+    // in volts, e.g. as saved with getZeroVolts(); must be called after
+    // adc.setGain()
     void setZero(float newZeroVolts) {
-        zeroVolts = newZeroVolts;
-        medianVolts.reset(newZeroVolts);
-        printSetZeroVolts();
+        setZeroCounts(lroundf(newZeroVolts / adc.computeVolts(1)));
+    }
+
+    void setZeroCounts(int16_t newZeroCounts) {
+        zeroCounts = newZeroCounts;
+        zeroChanged = true;
+        medianCounts.reset(newZeroCounts);
+        printSetZero();
     }
 
-    float getLatestVolts() { return medianVolts.getLatest() - zeroVolts; }
+    float getZeroVolts() { return adc.computeVolts(zeroCounts); }
+
+    int16_t getZeroCounts() const { return zeroCounts; }
+
+    // relative to the zero
+    int32_t getLatestCounts() { return medianCounts.getLatest() - zeroCounts; }
+
+    int32_t getMedianCounts() { return medianCounts.getMedian() - zeroCounts; }
+
+    int32_t getLatestUnits() { return toUnits(getLatestCounts()); }
+
+    int32_t getMedianUnits() { return toUnits(getMedianCounts()); }
 
-    float getMedianVolts() { return medianVolts.getMedian() - zeroVolts; }
+    // Polls ADC for a new reading and saves it. In continuous mode, returns
+    // false without touching the I2C bus if there is no new conversion.
+    bool tick() {
+        int64_t ts;
+
+        if (readyPin >= 0) {
+            uint32_t readyCount;
+
+            portENTER_CRITICAL(&readyMux);
+            readyCount = this->readyCount;
+            ts = readyTs;
+            this->readyCount = 0;
+            portEXIT_CRITICAL(&readyMux);
+
+            if (readyCount == 0) {
+                return false;
+            }
+            missedConversions += readyCount - 1;
+        } else {
+            ts = esp_timer_get_time();
+
+            if (continuous) {
+                if (ts < nextPollTs) {
+                    return false;
+                }
+                // stay in step with the conversions, but don't catch up
+                // with repeated reads after falling behind
+                nextPollTs += conversionPeriodUs;
+                if (nextPollTs <= ts) {
+                    nextPollTs = ts + conversionPeriodUs;
+                }
+            }
+        }
 
-    // polls ADC for a new reading and saves it
-    void tick() { medianVolts.add(readVolts()); }
+        saveReading(readCounts(), ts);
+        return true;
+    }
 
    private:
     const char* debugName;
@@ -85,10 +259,62 @@ class MovingMedianADC {
     const ADCMode mode;
 
     bool continuous = false;
-    float zeroVolts = 0;
-    utils::MovingMedian<float> medianVolts;
+    // without the ready interrupt, when tick() next reads a conversion
+    int64_t conversionPeriodUs = 0;
+    int64_t nextPollTs = 0;
+
+    int16_t zeroCounts = 0;
+    bool zeroChanged = false;  // since the last queued reading
+    utils::MovingMedian<int16_t, WindowSize> medianCounts;
+    CountsScale scale;
+
+    bool recalibrating = false;
+    int calibrationSampleIndex = 0;
+    std::array<int16_t, CalibrationSampleCount> calibrationSamples;
+
+    bool queueSamples = false;
+    SampleQueue<ADCSample, ADC_SAMPLE_QUEUE_CAPACITY> samples;
+    uint32_t droppedSamples = 0;
+
+    // written by the ready interrupt
+    int readyPin = -1;
+    portMUX_TYPE readyMux = portMUX_INITIALIZER_UNLOCKED;
+    volatile uint32_t readyCount = 0;  // conversions since the last tick()
+    volatile int64_t readyTs = 0;      // end of the latest conversion
+    uint32_t missedConversions = 0;
+
+    static void IRAM_ATTR onReady(void* arg) {
+        MovingMedianADC* self = (MovingMedianADC*)arg;
+
+        portENTER_CRITICAL_ISR(&self->readyMux);
+        self->readyTs = esp_timer_get_time();
+        self->readyCount++;
+        portEXIT_CRITICAL_ISR(&self->readyMux);
+    }
+
+    void saveReading(int16_t counts, int64_t ts) {
+        medianCounts.add(counts);
+
+        if (queueSamples) {
+            if (samples.push({ts, (int32_t)counts - zeroCounts, zeroChanged})) {
+                zeroChanged = false;
+            } else {
+                droppedSamples++;
+            }
+        }
+
+        if (recalibrating) {
+            calibrationSamples[calibrationSampleIndex++] = counts;
+            if (calibrationSampleIndex == CalibrationSampleCount) {
+                recalibrating = false;
+                // reorders the samples, which are no longer needed
+                setZeroCounts(utils::medianInPlace(calibrationSamples.begin(),
+                                                   calibrationSamples.end()));
+            }
+        }
+    }
 
-    float readVolts() {
+    int16_t readCounts() {
         int16_t counts;
 
         if (continuous) {
@@ -116,13 +342,13 @@ class MovingMedianADC {
             }
         }
 
-        return adc.computeVolts(counts);
+        return counts;
     }
 
-    void printSetZeroVolts() {
+    void printSetZero() {
         Serial.print("Set zero to ");
-        Serial.print(zeroVolts);
-        Serial.print("volts for ");
+        Serial.print(zeroCounts);
+        Serial.print(" counts for ");
         Serial.println(debugName);
     }
 };
@@ -0,0 +1,57 @@
+#ifndef SAMPLE_QUEUE_H_
+#define SAMPLE_QUEUE_H_
+
+#include <atomic>
+
+// Lock-free single-producer single-consumer queue with a fixed capacity, so
+// the producer and consumer can be different tasks and nothing is allocated.
+template <typename T, int Capacity>
+class SampleQueue {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+   public:
+    // Producer only. Returns false, dropping `item`, if the queue is full.
+    bool push(const T& item) {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        uint32_t tail = this->tail.load(std::memory_order_acquire);
+        if (head - tail >= Capacity) {
+            return false;
+        }
+        items[head & (Capacity - 1)] = item;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if the queue is empty.
+    bool pop(T& item) {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        uint32_t head = this->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        item = items[tail & (Capacity - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Like pop(), but leaves `item` in the queue.
+    bool peek(T& item) {
+        uint32_t tail = this->tail.load(std::memory_order_relaxed);
+        uint32_t head = this->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        item = items[tail & (Capacity - 1)];
+        return true;
+    }
+
+   private:
+    T items[Capacity];
+
+    // free-running counters; only their difference matters
+    std::atomic<uint32_t> head{0};  // written by producer
+    std::atomic<uint32_t> tail{0};  // written by consumer
+};
+
+#endif  // SAMPLE_QUEUE_H_
@@ -1,51 +1,186 @@
 #ifndef UTILS_H_
 #define UTILS_H_
 
+#include <algorithm>
+#include <array>
+#include <iterator>
 #include <vector>
 
 namespace utils {
 
-// returns 0 if the vector is empty
-template <typename T>
-T median(const std::vector<T> &a) {
-    if (a.empty()) {
+// Returns the median of [first, last), reordering it. Returns 0 if the range
+// is empty.
+template <typename Iterator>
+typename std::iterator_traits<Iterator>::value_type medianInPlace(
+    Iterator first, Iterator last) {
+    if (first == last) {
         return 0;
     }
 
+    Iterator middle = first + (last - first) / 2;
+    std::nth_element(first, middle, last);
+    return *middle;
+}
+
+// returns 0 if the vector is empty
+template <typename T>
+T median(const std::vector<T> &a) {
     std::vector<T> b = a;
-    int index = b.size() / 2;
-    std::nth_element(b.begin(), b.begin() + index, b.end());
-    return b[index];
+    return medianInPlace(b.begin(), b.end());
 }
 
+namespace detail {
+
+// std::arrays are already the right size
+template <typename T, size_t N>
+void resizeTo(int, std::array<T, N>&) {}
+
 template <typename T>
-class MovingMedian {
-   public:
-    MovingMedian(int windowSize, T initialValue) : windowSize(windowSize) {
-        for (int i = 0; i < windowSize; i++) {
-            values.push_back(initialValue);
-        }
-    }
+void resizeTo(int size, std::vector<T>& container) {
+    container.resize(size);
+}
 
+// Median of a sliding window, stored in `Values`, with `Indices` holding an
+// int per value; see MovingMedian. The window size is the size of the
+// containers, so with std::array it is a compile-time constant.
+template <typename T, typename Values, typename Indices>
+class SlidingMedian {
+   public:
     void reset(T initialValue) {
-        for (int i = 0; i < windowSize; i++) {
+        // all values are equal, so any arrangement is a valid pair of heaps
+        for (int i = 0; i < size(); i++) {
             values[i] = initialValue;
+            heap[i] = i;
+            heapIndex[i] = i;
         }
+        latest = size() - 1;
     }
 
     void add(T value) {
-        // `values` is always kept at `windowSize` elements
-        values.erase(values.begin());
-        values.push_back(value);
+        // overwrite the oldest value
+        latest = latest + 1 < size() ? latest + 1 : 0;
+        values[latest] = value;
+
+        int i = heapIndex[latest];
+        bool low = i < lowSize();
+        int local = low ? i : i - lowSize();
+        siftDown(low, siftUp(low, local));
+
+        // the new value may belong in the other half; if so, swapping the two
+        // tops puts it there
+        if (lowSize() > 0 && values[heap[lowSize()]] < values[heap[0]]) {
+            swapEntries(0, lowSize());
+            siftDown(true, 0);
+            siftDown(false, 0);
+        }
     }
 
-    T getMedian() { return median(values); }
+    // For an even window, the upper of the two middle values.
+    T getMedian() const { return values[heap[lowSize()]]; }
+
+    T getLatest() const { return values[latest]; }
 
-    T getLatest() { return values.back(); }
+   protected:
+    SlidingMedian(int windowSize, T initialValue) {
+        resizeTo(windowSize, values);
+        resizeTo(windowSize, heap);
+        resizeTo(windowSize, heapIndex);
+        reset(initialValue);
+    }
 
    private:
-    const int windowSize;
-    std::vector<T> values;
+    Values values;
+    // heap[0, lowSize()) is the max-heap of the lower half, and
+    // heap[lowSize(), size()) the min-heap of the upper half; both hold
+    // indices into `values`, and heapIndex is the inverse mapping
+    Indices heap;
+    Indices heapIndex;
+    int latest;  // index of the newest value
+
+    int size() const { return values.size(); }
+    int lowSize() const { return size() / 2; }
+
+    // true if value `a` belongs above value `b` in the given heap
+    bool above(bool low, int a, int b) const {
+        return low ? values[b] < values[a] : values[a] < values[b];
+    }
+
+    void swapEntries(int i, int j) {
+        std::swap(heap[i], heap[j]);
+        heapIndex[heap[i]] = i;
+        heapIndex[heap[j]] = j;
+    }
+
+    // `i` is relative to the start of the heap; returns its new position
+    int siftUp(bool low, int i) {
+        int base = low ? 0 : lowSize();
+
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!above(low, heap[base + i], heap[base + parent])) {
+                break;
+            }
+            swapEntries(base + i, base + parent);
+            i = parent;
+        }
+        return i;
+    }
+
+    void siftDown(bool low, int i) {
+        int base = low ? 0 : lowSize();
+        int heapSize = low ? lowSize() : size() - lowSize();
+
+        while (true) {
+            int top = i;
+            for (int child = 2 * i + 1; child <= 2 * i + 2; child++) {
+                if (child < heapSize &&
+                    above(low, heap[base + child], heap[base + top])) {
+                    top = child;
+                }
+            }
+            if (top == i) {
+                return;
+            }
+            swapEntries(base + i, base + top);
+            i = top;
+        }
+    }
+};
+
+}  // namespace detail
+
+// Pass as the window size to choose it at runtime.
+const int DYNAMIC_WINDOW = 0;
+
+// Median of the last `WindowSize` values. The window is split into two heaps
+// over a circular buffer: a max-heap of the lower half and a min-heap of the
+// upper half, whose top is the median. Adding a value overwrites the oldest
+// one in place and restores both heaps, so add() is O(log n) and getMedian()
+// is O(1).
+//
+// The buffers are std::arrays, so nothing is allocated at all.
+template <typename T, int WindowSize = DYNAMIC_WINDOW>
+class MovingMedian
+    : public detail::SlidingMedian<T, std::array<T, WindowSize>,
+                                   std::array<int, WindowSize>> {
+    static_assert(WindowSize > 0, "WindowSize must be positive");
+
+   public:
+    explicit MovingMedian(T initialValue)
+        : detail::SlidingMedian<T, std::array<T, WindowSize>,
+                                std::array<int, WindowSize>>(WindowSize,
+                                                             initialValue) {}
+};
+
+// Same, with the window size chosen at runtime. The buffers are allocated in
+// the constructor, and never after.
+template <typename T>
+class MovingMedian<T, DYNAMIC_WINDOW>
+    : public detail::SlidingMedian<T, std::vector<T>, std::vector<int>> {
+   public:
+    MovingMedian(int windowSize, T initialValue)
+        : detail::SlidingMedian<T, std::vector<T>, std::vector<int>>(
+              windowSize, initialValue) {}
 };
 
 }  // namespace utils
@@ -0,0 +1,103 @@
+#ifndef BATCH_ENCODER_H_
+#define BATCH_ENCODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packet_framing.h"
+
+// Packs several timestamped samples of `ChannelCount` int32 readings into one
+// payload:
+//
+//   ts value...                 first sample, big endian int64 and int32s
+//   varint(dts) svarint(dv)...  every next sample, as deltas from the last
+//
+// varint is LEB128 (7 bits per byte, low bits first, high bit set on every
+// byte but the last), and svarint zigzag encodes a signed delta first. A batch
+// of one sample is laid out exactly like a plain packet. Deltas between
+// consecutive readings are usually a byte or two, so a batch takes a fraction
+// of the bytes of separate packets.
+//
+// pi_serial_uploader/batch.py decodes these on the Pi.
+template <int ChannelCount, int MaxSamples>
+class BatchEncoder {
+    static_assert(ChannelCount > 0, "ChannelCount must be positive");
+    static_assert(MaxSamples > 0, "MaxSamples must be positive");
+
+   public:
+    static const size_t MAX_VARINT_SIZE = 10;
+    static const size_t MAX_PAYLOAD_SIZE =
+        8 + 4 * ChannelCount +
+        (MaxSamples - 1) * MAX_VARINT_SIZE * (1 + ChannelCount);
+
+    // `ts` must not be before the last sample's. Returns false, dropping the
+    // sample, if the batch is full.
+    bool add(int64_t ts, const int32_t (&values)[ChannelCount]) {
+        if (sampleCount == MaxSamples) {
+            return false;
+        }
+
+        if (sampleCount == 0) {
+            packet_framing::putBigEndian(payload + size, ts, 8);
+            size += 8;
+            for (int i = 0; i < ChannelCount; i++) {
+                packet_framing::putBigEndian(payload + size, values[i], 4);
+                size += 4;
+            }
+        } else {
+            putVarint(ts - lastTs);
+            for (int i = 0; i < ChannelCount; i++) {
+                int64_t delta = (int64_t)values[i] - lastValues[i];
+                // zigzag: 0, -1, 1, -2... to 0, 1, 2, 3...
+                putVarint(((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+            }
+        }
+
+        lastTs = ts;
+        for (int i = 0; i < ChannelCount; i++) {
+            lastValues[i] = values[i];
+        }
+        if (sampleCount == 0) {
+            firstTs = ts;
+        }
+        sampleCount++;
+        return true;
+    }
+
+    void clear() {
+        sampleCount = 0;
+        size = 0;
+    }
+
+    bool isEmpty() const { return sampleCount == 0; }
+
+    bool isFull() const { return sampleCount == MaxSamples; }
+
+    int getSampleCount() const { return sampleCount; }
+
+    // of the first sample; only valid if not empty
+    int64_t getFirstTs() const { return firstTs; }
+
+    const uint8_t* getPayload() const { return payload; }
+
+    size_t getPayloadSize() const { return size; }
+
+   private:
+    uint8_t payload[MAX_PAYLOAD_SIZE];
+    size_t size = 0;
+    int sampleCount = 0;
+
+    int64_t firstTs = 0;
+    int64_t lastTs = 0;
+    int32_t lastValues[ChannelCount];
+
+    void putVarint(uint64_t value) {
+        while (value >= 0x80) {
+            payload[size++] = (value & 0x7F) | 0x80;
+            value >>= 7;
+        }
+        payload[size++] = value;
+    }
+};
+
+#endif  // BATCH_ENCODER_H_
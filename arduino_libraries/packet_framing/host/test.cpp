@@ -0,0 +1,196 @@
+// Tests for FrameReader, which fs_main decodes the scientific module's
+// pressures with: frames from FrameWriter round trip, and corrupted, oversize
+// and missing frames are dropped and counted without losing sync. Exits with a
+// non-zero status if any check fails. See the Makefile for how to build and
+// run it.
+//
+// pi_serial_uploader/tests checks the Pi's decoder against FrameWriter.
+
+#include <packet_framing.h>
+#include <stdio.h>
+
+#include <vector>
+
+using namespace packet_framing;
+
+typedef std::vector<uint8_t> Bytes;
+
+int failures = 0;
+
+#define CHECK(condition)                                                \
+    do {                                                                \
+        if (!(condition)) {                                             \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__,     \
+                   #condition);                                         \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+// including the delimiter
+Bytes writeFrame(FrameWriter& writer, const Bytes& payload) {
+    Bytes frame(maxFrameSize(payload.size()));
+    frame.resize(writer.write(payload.data(), payload.size(), frame.data()));
+    return frame;
+}
+
+// Pushes `bytes` into `reader`; returns the payloads of the frames it got.
+template <size_t MaxPayloadSize>
+std::vector<Bytes> push(FrameReader<MaxPayloadSize>& reader,
+                        const Bytes& bytes) {
+    std::vector<Bytes> payloads;
+    for (uint8_t byte : bytes) {
+        if (reader.push(byte)) {
+            payloads.push_back(Bytes(
+                reader.getPayload(),
+                reader.getPayload() + reader.getPayloadSize()));
+        }
+    }
+    return payloads;
+}
+
+template <size_t MaxPayloadSize>
+bool receives(FrameReader<MaxPayloadSize>& reader, const Bytes& frame,
+              const Bytes& payload) {
+    std::vector<Bytes> payloads = push(reader, frame);
+    return payloads.size() == 1 && payloads[0] == payload;
+}
+
+void testRoundTrip() {
+    FrameWriter writer;
+    FrameReader<600> reader;
+
+    // no zeros, across the 254 byte COBS block boundary a few times
+    for (size_t size = 0; size <= 600; size++) {
+        Bytes payload(size, 0x01 + size % 0xFF);
+        CHECK(receives(reader, writeFrame(writer, payload), payload));
+        CHECK(reader.getSeq() == size);
+    }
+
+    // only zeros, and zeros either side of each block boundary
+    for (size_t size = 1; size <= 4; size++) {
+        Bytes payload(size, 0x00);
+        CHECK(receives(reader, writeFrame(writer, payload), payload));
+    }
+    for (size_t zeroAt = 248; zeroAt <= 260; zeroAt++) {
+        Bytes payload(600, 0xFF);
+        payload[zeroAt] = 0;
+        payload[zeroAt + 254] = 0;
+        CHECK(receives(reader, writeFrame(writer, payload), payload));
+    }
+
+    CHECK(reader.getLostFrameCount() == 0);
+    CHECK(reader.getMalformedFrameCount() == 0);
+    CHECK(reader.getCrcErrorCount() == 0);
+}
+
+void testCrcMismatch() {
+    FrameWriter writer;
+    FrameReader<16> reader;
+
+    // still valid COBS, as a non-zero byte is swapped for another
+    Bytes corrupt = writeFrame(writer, {1, 2, 3, 4});
+    corrupt[4] ^= 0x10;
+    CHECK(push(reader, corrupt).empty());
+    CHECK(reader.getCrcErrorCount() == 1);
+    CHECK(reader.getMalformedFrameCount() == 0);
+
+    // the next frame is read, and the corrupt one counts as lost once the
+    // reader has a sequence number to count from
+    CHECK(receives(reader, writeFrame(writer, {5, 6}), {5, 6}));
+    CHECK(reader.getSeq() == 1);
+    CHECK(reader.getLostFrameCount() == 0);
+
+    corrupt = writeFrame(writer, {7, 8, 9});
+    corrupt[corrupt.size() - 2] ^= 0x01;  // in the CRC itself
+    CHECK(push(reader, corrupt).empty());
+    CHECK(reader.getCrcErrorCount() == 2);
+    CHECK(receives(reader, writeFrame(writer, {10}), {10}));
+    CHECK(reader.getLostFrameCount() == 1);
+}
+
+void testOversizeFrame() {
+    FrameWriter writer;
+    FrameReader<8> reader;
+
+    // the largest payload
+    Bytes largest = {1, 2, 3, 0, 5, 6, 7, 8};
+    CHECK(receives(reader, writeFrame(writer, largest), largest));
+
+    Bytes tooLarge(9, 0xAA);
+    CHECK(push(reader, writeFrame(writer, tooLarge)).empty());
+    CHECK(reader.getMalformedFrameCount() == 1);
+
+    // far past the buffer, e.g. noise without a delimiter
+    Bytes noise(5000, 0x55);
+    noise.push_back(FRAME_DELIMITER);
+    CHECK(push(reader, noise).empty());
+    CHECK(reader.getMalformedFrameCount() == 2);
+
+    // resyncs at the delimiter
+    CHECK(receives(reader, writeFrame(writer, {1}), {1}));
+    CHECK(reader.getCrcErrorCount() == 0);
+}
+
+void testMalformedFrames() {
+    FrameReader<16> reader;
+
+    // consecutive delimiters, e.g. the reader resyncing, are ignored
+    CHECK(push(reader, {FRAME_DELIMITER, FRAME_DELIMITER}).empty());
+    CHECK(reader.getMalformedFrameCount() == 0);
+
+    // a block longer than the frame
+    CHECK(push(reader, {0x09, 1, 2, FRAME_DELIMITER}).empty());
+    // valid COBS, but shorter than seq and crc
+    CHECK(push(reader, {0x04, 1, 2, 3, FRAME_DELIMITER}).empty());
+    CHECK(reader.getMalformedFrameCount() == 2);
+    CHECK(reader.getCrcErrorCount() == 0);
+
+    // joining mid-frame drops the partial one only
+    FrameWriter writer;
+    Bytes frame = writeFrame(writer, {1, 2, 3, 4, 5, 6});
+    CHECK(push(reader, Bytes(frame.begin() + 3, frame.end())).empty());
+    CHECK(receives(reader, writeFrame(writer, {7}), {7}));
+    CHECK(reader.getLostFrameCount() == 0);
+}
+
+void testLostFrames() {
+    FrameWriter writer;
+    FrameReader<16> reader;
+
+    // the first frame read sets the sequence, whatever it is
+    writeFrame(writer, {0});
+    CHECK(receives(reader, writeFrame(writer, {1}), {1}));
+    CHECK(reader.getLostFrameCount() == 0);
+
+    writeFrame(writer, {2});
+    writeFrame(writer, {3});
+    CHECK(receives(reader, writeFrame(writer, {4}), {4}));
+    CHECK(reader.getSeq() == 4);
+    CHECK(reader.getLostFrameCount() == 2);
+
+    // a gap across the sequence number wrapping
+    for (int i = 5; i <= 65534; i++) {
+        CHECK(receives(reader, writeFrame(writer, {}), {}));
+    }
+    CHECK(reader.getSeq() == 65534);
+    writeFrame(writer, {});
+    writeFrame(writer, {});
+    CHECK(receives(reader, writeFrame(writer, {}), {}));
+    CHECK(reader.getSeq() == 1);
+    CHECK(reader.getLostFrameCount() == 4);
+}
+
+int main() {
+    testRoundTrip();
+    testCrcMismatch();
+    testOversizeFrame();
+    testMalformedFrames();
+    testLostFrames();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,230 @@
+#ifndef PACKET_FRAMING_H_
+#define PACKET_FRAMING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Framing for binary packets over a serial link. Each frame is
+//
+//   COBS(seq payload crc) 0x00
+//
+// where seq is a 16 bit sequence number, incremented for every frame, and crc
+// is the CRC-16/CCITT-FALSE of seq and payload, both big endian. COBS removes
+// every 0x00 from the encoded bytes, so 0x00 only ever marks the end of a
+// frame: a reader resyncs at the next one, corrupted frames fail the CRC, and
+// gaps in seq count exactly how many frames were lost.
+//
+// pi_serial_uploader/framing.py decodes these on the Pi.
+namespace packet_framing {
+
+const uint8_t FRAME_DELIMITER = 0x00;
+
+// seq and crc
+const size_t FRAME_OVERHEAD = 2 + 2;
+
+// largest frame for a payload of `payloadSize` bytes, including the delimiter;
+// COBS adds a byte per 254 bytes, plus one
+constexpr size_t maxFrameSize(size_t payloadSize) {
+    return payloadSize + FRAME_OVERHEAD +
+           (payloadSize + FRAME_OVERHEAD) / 254 + 1 + 1;
+}
+
+// Writes the low `bytes` bytes of `value` to `dest`, big endian.
+inline void putBigEndian(uint8_t* dest, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        dest[i] = value >> (8 * (bytes - 1 - i));
+    }
+}
+
+// Reads `bytes` big endian bytes from `src`; cast the result to the signed
+// type of that size for signed values.
+inline uint64_t getBigEndian(const uint8_t* src, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | src[i];
+    }
+    return value;
+}
+
+inline uint16_t crc16(const uint8_t* data, size_t size,
+                      uint16_t crc = 0xFFFF) {
+    for (size_t i = 0; i < size; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// COBS encodes bytes one at a time into `dest`, which must hold the encoded
+// size.
+class CobsEncoder {
+   public:
+    explicit CobsEncoder(uint8_t* dest) : dest(dest) {}
+
+    void put(uint8_t byte) {
+        if (byte == 0) {
+            endBlock();
+            return;
+        }
+        dest[size++] = byte;
+        if (++code == 0xFF) {
+            endBlock();
+        }
+    }
+
+    void put(const uint8_t* bytes, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            put(bytes[i]);
+        }
+    }
+
+    // Returns the encoded size.
+    size_t finish() {
+        dest[codeIndex] = code;
+        return size;
+    }
+
+   private:
+    uint8_t* dest;
+    size_t codeIndex = 0;  // where the current block's length goes
+    size_t size = 1;
+    uint8_t code = 1;
+
+    void endBlock() {
+        dest[codeIndex] = code;
+        codeIndex = size++;
+        code = 1;
+    }
+};
+
+// Decodes `size` COBS bytes, without the delimiter, into `dest`, which may be
+// `src`. Returns the decoded size, or -1 if they aren't valid COBS.
+inline int cobsDecode(const uint8_t* src, size_t size, uint8_t* dest) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < size) {
+        uint8_t code = src[in++];
+        if (code == 0 || in + code - 1 > size) {
+            return -1;
+        }
+        for (int i = 1; i < code; i++) {
+            dest[out++] = src[in++];
+        }
+        // the last block has no implied zero after it
+        if (code != 0xFF && in < size) {
+            dest[out++] = 0;
+        }
+    }
+
+    return out;
+}
+
+// Frames payloads with consecutive sequence numbers.
+class FrameWriter {
+   public:
+    // Writes the frame for `payload` to `dest`, which must hold
+    // maxFrameSize(size) bytes. Returns the frame size.
+    size_t write(const uint8_t* payload, size_t size, uint8_t* dest) {
+        uint8_t seqBytes[] = {(uint8_t)(seq >> 8), (uint8_t)seq};
+        uint16_t crc = crc16(payload, size, crc16(seqBytes, sizeof(seqBytes)));
+        uint8_t crcBytes[] = {(uint8_t)(crc >> 8), (uint8_t)crc};
+        seq++;
+
+        CobsEncoder encoder(dest);
+        encoder.put(seqBytes, sizeof(seqBytes));
+        encoder.put(payload, size);
+        encoder.put(crcBytes, sizeof(crcBytes));
+        size_t frameSize = encoder.finish();
+
+        dest[frameSize++] = FRAME_DELIMITER;
+        return frameSize;
+    }
+
+   private:
+    uint16_t seq = 0;
+};
+
+// Reassembles frames from a byte stream, dropping any that are too long,
+// aren't valid COBS or fail the CRC.
+template <size_t MaxPayloadSize>
+class FrameReader {
+   public:
+    // Returns true if `byte` completed a valid frame, whose payload is then
+    // available until the next call.
+    bool push(uint8_t byte) {
+        if (byte != FRAME_DELIMITER) {
+            if (size < sizeof(buffer)) {
+                buffer[size] = byte;
+            }
+            size++;  // past the buffer means the frame is too long
+            return false;
+        }
+
+        size_t frameSize = size;
+        size = 0;
+        if (frameSize == 0) {
+            return false;
+        }
+        if (frameSize > sizeof(buffer)) {
+            malformedFrames++;
+            return false;
+        }
+
+        int decodedSize = cobsDecode(buffer, frameSize, buffer);
+        if (decodedSize < (int)FRAME_OVERHEAD) {
+            malformedFrames++;
+            return false;
+        }
+
+        payloadSize = decodedSize - FRAME_OVERHEAD;
+        uint16_t crc = (buffer[decodedSize - 2] << 8) | buffer[decodedSize - 1];
+        if (crc16(buffer, decodedSize - 2) != crc) {
+            crcErrors++;
+            return false;
+        }
+
+        seq = (buffer[0] << 8) | buffer[1];
+        if (synced) {
+            lostFrames += (uint16_t)(seq - nextSeq);
+        }
+        nextSeq = seq + 1;
+        synced = true;
+        return true;
+    }
+
+    const uint8_t* getPayload() const { return buffer + 2; }
+
+    size_t getPayloadSize() const { return payloadSize; }
+
+    // of the last valid frame
+    uint16_t getSeq() const { return seq; }
+
+    // frames that were too long or not valid COBS
+    uint32_t getMalformedFrameCount() const { return malformedFrames; }
+
+    uint32_t getCrcErrorCount() const { return crcErrors; }
+
+    // frames missing from the sequence numbers; includes dropped frames
+    uint32_t getLostFrameCount() const { return lostFrames; }
+
+   private:
+    // encoded bytes, decoded in place
+    uint8_t buffer[maxFrameSize(MaxPayloadSize) - 1];
+    size_t size = 0;
+    size_t payloadSize = 0;
+
+    bool synced = false;
+    uint16_t seq = 0;
+    uint16_t nextSeq = 0;
+
+    uint32_t malformedFrames = 0;
+    uint32_t crcErrors = 0;
+    uint32_t lostFrames = 0;
+};
+
+}  // namespace packet_framing
+
+#endif  // PACKET_FRAMING_H_
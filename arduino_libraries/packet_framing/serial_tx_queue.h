@@ -0,0 +1,84 @@
+#ifndef SERIAL_TX_QUEUE_H_
+#define SERIAL_TX_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Preallocated ring of bytes waiting to go out on a serial port, so writing
+// never blocks. HardwareSerial::write() blocks until everything fits in the
+// UART driver's TX buffer; tick() only hands the driver as much as it has room
+// for, and push() drops whole frames, counting them, when the ring is full.
+//
+// Not thread safe; push() and tick() must be called from the same task.
+template <size_t Capacity>
+class SerialTxQueue {
+   public:
+    // Queues all of `data`, or nothing if it doesn't fit.
+    bool push(const uint8_t* data, size_t size) {
+        if (size > Capacity - count) {
+            droppedFrames++;
+            droppedBytes += size;
+            return false;
+        }
+
+        size_t tail = (head + count) % Capacity;
+        size_t first = size < Capacity - tail ? size : Capacity - tail;
+        memcpy(buffer + tail, data, first);
+        memcpy(buffer, data + first, size - first);
+
+        count += size;
+        if (count > highWaterMark) {
+            highWaterMark = count;
+        }
+        return true;
+    }
+
+    // Writes as much as `sink` (e.g. a HardwareSerial) can take without
+    // blocking, according to its availableForWrite(). Returns the bytes
+    // written. Call often.
+    template <typename Sink>
+    size_t tick(Sink& sink) {
+        size_t written = 0;
+
+        while (count > 0) {
+            int space = sink.availableForWrite();
+            if (space <= 0) {
+                break;
+            }
+
+            // up to the end of the ring, then wrap on the next iteration
+            size_t chunk = count < Capacity - head ? count : Capacity - head;
+            if (chunk > (size_t)space) {
+                chunk = space;
+            }
+
+            sink.write(buffer + head, chunk);
+            head = (head + chunk) % Capacity;
+            count -= chunk;
+            written += chunk;
+        }
+
+        return written;
+    }
+
+    size_t size() const { return count; }
+
+    uint32_t getDroppedFrameCount() const { return droppedFrames; }
+
+    uint32_t getDroppedByteCount() const { return droppedBytes; }
+
+    // most bytes ever queued at once
+    size_t getHighWaterMark() const { return highWaterMark; }
+
+   private:
+    uint8_t buffer[Capacity];
+    size_t head = 0;  // oldest byte
+    size_t count = 0;
+
+    uint32_t droppedFrames = 0;
+    uint32_t droppedBytes = 0;
+    size_t highWaterMark = 0;
+};
+
+#endif  // SERIAL_TX_QUEUE_H_
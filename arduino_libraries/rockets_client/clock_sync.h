@@ -0,0 +1,139 @@
+#ifndef CLOCK_SYNC_H_
+#define CLOCK_SYNC_H_
+
+#include <Arduino.h>
+
+namespace rockets_client {
+
+// Estimates the server clock from round trips to GET /ts, NTP style. Each
+// sample assumes the server read its clock halfway between sending the request
+// and receiving the response, so the error of a sample is at most half its
+// round trip time; of all samples taken in a round, only the one with the
+// lowest round trip time is used.
+//
+// Between rounds the offset is extrapolated with the measured drift, and a
+// new estimate is slewed in gradually rather than stepped, so that timestamps
+// stay continuous and monotonic.
+//
+// All times are in microseconds. Not thread safe.
+class ClockSync {
+   public:
+    // max rate at which a correction is slewed in (1 ms per second)
+    static constexpr double MAX_SLEW_RATE = 0.001;
+    // corrections larger than this are stepped rather than slewed
+    static const int64_t MAX_SLEW_US = 100 * 1000;
+    // clamp on the estimated drift of the local clock (500 ppm)
+    static constexpr double MAX_DRIFT = 0.0005;
+    // drift is only estimated from samples at least this far apart
+    static const int64_t MIN_DRIFT_INTERVAL_US = 5 * 1000 * 1000;
+
+    // Adds a sample from a request sent at local time `localSend` whose
+    // response, carrying server time `serverTs`, arrived at `localReceive`.
+    void addSample(int64_t localSend, int64_t localReceive, int64_t serverTs) {
+        int64_t rtt = localReceive - localSend;
+        if (rtt < 0) {
+            return;
+        }
+
+        if (sampleCount == 0 || rtt < best.rtt) {
+            best.rtt = rtt;
+            best.local = localSend + rtt / 2;
+            best.offset = serverTs - best.local;
+        }
+        sampleCount++;
+    }
+
+    // number of samples added since the last apply()
+    int getSampleCount() const { return sampleCount; }
+
+    // round trip time of the best sample since the last apply()
+    int64_t getBestRtt() const { return best.rtt; }
+
+    // Updates the estimate from the best sample since the last call, and
+    // starts a new round. The first call, and any call with `step` set, jumps
+    // straight to the new estimate; otherwise the difference from the current
+    // estimate is slewed in starting at local time `now`. Returns false if
+    // there were no samples.
+    bool apply(int64_t now, bool step) {
+        if (sampleCount == 0) {
+            return false;
+        }
+        sampleCount = 0;
+
+        int64_t oldOffset = getOffset(now);
+
+        if (!synced) {
+            synced = true;
+            step = true;
+        } else if (best.local - anchor.local >= MIN_DRIFT_INTERVAL_US) {
+            // compare raw samples; slewing doesn't affect the anchor
+            double measured = (double)(best.offset - anchor.offset) /
+                              (best.local - anchor.local);
+            drift = constrain(measured, -MAX_DRIFT, MAX_DRIFT);
+        }
+
+        anchor = best;
+        slewStart = now;
+        slewTotal = 0;
+
+        int64_t correction = modelOffset(now) - oldOffset;
+        if (!step && llabs(correction) <= MAX_SLEW_US) {
+            slewTotal = correction;
+        }
+
+        return true;
+    }
+
+    bool isSynced() const { return synced; }
+
+    // Add this to a local timestamp taken at `local` to get server time.
+    int64_t getOffset(int64_t local) const {
+        return modelOffset(local) - slewRemaining(local);
+    }
+
+    int64_t toServerTime(int64_t local) const {
+        return local + getOffset(local);
+    }
+
+   private:
+    struct Sample {
+        int64_t rtt;
+        int64_t local;   // local time at the midpoint of the round trip
+        int64_t offset;  // server time minus local time at `local`
+    };
+
+    bool synced = false;
+
+    Sample best = {0, 0, 0};
+    int sampleCount = 0;
+
+    Sample anchor = {0, 0, 0};
+    double drift = 0;
+
+    int64_t slewStart = 0;
+    int64_t slewTotal = 0;
+
+    int64_t modelOffset(int64_t local) const {
+        return anchor.offset + (int64_t)(drift * (local - anchor.local));
+    }
+
+    // part of the last correction that hasn't been slewed in yet at `local`
+    int64_t slewRemaining(int64_t local) const {
+        if (slewTotal == 0) {
+            return 0;
+        }
+
+        int64_t elapsed = local > slewStart ? local - slewStart : 0;
+        int64_t slewed = elapsed * MAX_SLEW_RATE;
+
+        if (slewTotal > 0) {
+            return slewed >= slewTotal ? 0 : slewTotal - slewed;
+        } else {
+            return slewed >= -slewTotal ? 0 : slewTotal + slewed;
+        }
+    }
+};
+
+}  // namespace rockets_client
+
+#endif  // CLOCK_SYNC_H_
@@ -0,0 +1,65 @@
+#ifndef DOC_SNAPSHOT_H_
+#define DOC_SNAPSHOT_H_
+
+#include <Arduino.h>
+
+namespace rockets_client {
+
+// Double-buffered, version-stamped document shared between one writer task
+// and any number of readers. The writer fills the back buffer without holding
+// the lock and then swaps it in, and readers borrow the front buffer under the
+// lock, so a document is never copied unless a reader asks for a copy, and
+// readers can skip documents they have already seen.
+template <typename Doc>
+class DocSnapshot {
+   public:
+    // Must be called before any other method.
+    void init() { mutex = xSemaphoreCreateMutex(); }
+
+    // Writer only. Returns the buffer to fill; its previous contents are
+    // stale and should be overwritten.
+    Doc& beginWrite() { return *back; }
+
+    // Writer only. Publishes the buffer returned by beginWrite().
+    void commitWrite() {
+        if (xSemaphoreTake(mutex, portMAX_DELAY)) {
+            Doc* published = back;
+            back = front;
+            front = published;
+            version++;
+            xSemaphoreGive(mutex);
+        }
+    }
+
+    // If a document newer than `lastVersion` has been published, calls
+    // `callback` with it while holding the lock, sets `lastVersion` to its
+    // version and returns true. Version 0 is never published, so pass 0 to get
+    // the first document. Keep the callback short; it blocks the writer.
+    template <typename Callback>
+    bool readIfNewer(uint32_t& lastVersion, Callback callback) {
+        bool newer = false;
+
+        if (xSemaphoreTake(mutex, portMAX_DELAY)) {
+            if (version != lastVersion) {
+                callback((const Doc&)*front);
+                lastVersion = version;
+                newer = true;
+            }
+            xSemaphoreGive(mutex);
+        }
+
+        return newer;
+    }
+
+   private:
+    Doc buffers[2];
+    Doc* front = &buffers[0];
+    Doc* back = &buffers[1];
+
+    uint32_t version = 0;
+    SemaphoreHandle_t mutex;
+};
+
+}  // namespace rockets_client
+
+#endif  // DOC_SNAPSHOT_H_
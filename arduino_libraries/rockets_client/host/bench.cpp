@@ -0,0 +1,141 @@
+// Runs rockets_client on the host against a server (usually
+// stand_in_server.py), queueing records at a fixed rate like the firing
+// station does, and prints throughput and latency at the end. See the Makefile
+// for how to build and run it.
+//
+// Usage: bench [-p port] [-r records per second] [-s seconds] [-m] [-c]
+//              [-w message wait ms]
+//   -m  upload records as MessagePack
+//   -c  close the connection after every request (no keep-alive)
+
+#include <rockets_client.h>
+#include <signal.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    int port = 3000;
+    int recordsPerSecond = 200;
+    int seconds = 10;
+    bool msgpack = false;
+    bool keepAlive = true;
+    unsigned long messageWaitMs = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "p:r:s:mcw:")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'r':
+                recordsPerSecond = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'm':
+                msgpack = true;
+                break;
+            case 'c':
+                keepAlive = false;
+                break;
+            case 'w':
+                messageWaitMs = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "See the top of bench.cpp for usage\n");
+                return 1;
+        }
+    }
+
+    // a server closing the connection shouldn't kill us
+    signal(SIGPIPE, SIG_IGN);
+
+    rockets_client::ServerConfig serverConfig = {
+        .host = "localhost",
+        .port = port,
+        .pathPrefix = "",
+        .keepAlive = keepAlive,
+        .recordEncoding = msgpack ? rockets_client::RecordEncoding::msgpack
+                                  : rockets_client::RecordEncoding::json,
+        .messageWaitMs = messageWaitMs,
+    };
+
+    rockets_client::init(rockets_client::wifiConfigPresets.GROUND, serverConfig,
+                         "0", "Bench", true, "Bench");
+
+    // let the first ts sync finish, so that records get server timestamps
+    delay(1000);
+
+    const int64_t periodUs = 1000000 / recordsPerSecond;
+    const int64_t start = esp_timer_get_time();
+    const int64_t end = start + (int64_t)seconds * 1000000;
+
+    int64_t queueTimeUs = 0;
+    uint32_t queueCalls = 0;
+    uint32_t messages = 0;
+    uint32_t recordsVersion = 0;
+    uint32_t recordsUpdates = 0;
+
+    for (int64_t next = start; next < end; next += periodUs) {
+        int64_t now = esp_timer_get_time();
+        if (next > now) {
+            std::this_thread::sleep_for(std::chrono::microseconds(next - now));
+        }
+
+        // a record like the firing station's
+        rockets_client::StaticJsonDoc recordData;
+        recordData["stateByte"] = 1;
+        recordData["relayStatusByte"] = 0x2a;
+        recordData["st1MPSI"] = 512345;
+        recordData["st2MPSI"] = 498765;
+        recordData["thermo1C"] = 21.5;
+        recordData["thermo2C"] = 22.25;
+        recordData["timeSinceBoot"] = esp_timer_get_time();
+        recordData["timeSinceCalibration"] = esp_timer_get_time() - start;
+
+        int64_t before = esp_timer_get_time();
+        rockets_client::queueRecord(recordData);
+        queueTimeUs += esp_timer_get_time() - before;
+        queueCalls++;
+
+        if (rockets_client::borrowLatestMessage(
+                [](const rockets_client::StaticJsonDoc& message) {})) {
+            messages++;
+        }
+        if (rockets_client::borrowLatestRecords(
+                recordsVersion,
+                [](const rockets_client::StaticJsonDoc& records) {})) {
+            recordsUpdates++;
+        }
+    }
+
+    // give the last batch a chance to go out
+    delay(500);
+
+    rockets_client::RecordStats stats = rockets_client::getRecordStats();
+
+    Serial.println("--- records");
+    Serial.print("  queued/sent/overflowed/dropped: ");
+    Serial.print(stats.queued);
+    Serial.print("/");
+    Serial.print(stats.sent);
+    Serial.print("/");
+    Serial.print(stats.overflowed);
+    Serial.print("/");
+    Serial.println(stats.dropped);
+    Serial.print("  sent per second: ");
+    Serial.println(stats.sent / seconds);
+    Serial.print("  mean queueRecord time (us): ");
+    Serial.println(queueTimeUs / queueCalls);
+    Serial.print("  messages received: ");
+    Serial.println(messages);
+    Serial.print("  polled records updates: ");
+    Serial.println(recordsUpdates);
+
+    Serial.println("--- network");
+    rockets_client::printNetworkStats();
+
+    // the pipeline threads never return, so skip static destructors
+    fflush(stdout);
+    _exit(0);
+}
@@ -0,0 +1,153 @@
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+// Just enough of the Arduino core, FreeRTOS and esp_timer for rockets_client
+// to build and run on a Linux or macOS host. Tasks are threads, mutexes are
+// std::mutex, and Serial is stdout.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+
+#define constrain(amt, low, high) \
+    ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// time
+
+inline int64_t esp_timer_get_time() {
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+}
+
+inline unsigned long millis() { return esp_timer_get_time() / 1000; }
+
+inline void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void yield() { std::this_thread::yield(); }
+
+// String
+
+class String {
+   public:
+    String(const char* str = "") : str(str) {}
+    String(const std::string& str) : str(str) {}
+
+    template <typename T, typename = typename std::enable_if<
+                              std::is_arithmetic<T>::value>::type>
+    explicit String(T value) : str(std::to_string(value)) {}
+
+    const char* c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.length(); }
+
+    String& operator+=(const String& other) {
+        str += other.str;
+        return *this;
+    }
+
+    bool operator==(const String& other) const { return str == other.str; }
+    bool operator!=(const String& other) const { return str != other.str; }
+
+   private:
+    std::string str;
+};
+
+inline String operator+(String lhs, const String& rhs) { return lhs += rhs; }
+
+inline String operator+(const char* lhs, const String& rhs) {
+    return String(lhs) += rhs;
+}
+
+template <typename T, typename = typename std::enable_if<
+                          std::is_arithmetic<T>::value>::type>
+String operator+(String lhs, T rhs) {
+    return lhs += String(rhs);
+}
+
+// Print
+
+class Print {
+   public:
+    virtual ~Print() {}
+
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+
+    size_t print(const char* str) {
+        return write((const uint8_t*)str, strlen(str));
+    }
+    size_t print(const String& str) { return print(str.c_str()); }
+
+    template <typename T, typename = typename std::enable_if<
+                              std::is_arithmetic<T>::value>::type>
+    size_t print(T value) {
+        return print(String(value));
+    }
+
+    size_t println() { return print("\r\n"); }
+
+    template <typename T>
+    size_t println(const T& value) {
+        size_t n = print(value);
+        return n + println();
+    }
+};
+
+class HardwareSerial : public Print {
+   public:
+    void begin(unsigned long baud) {}
+
+    size_t write(const uint8_t* buffer, size_t size) override {
+        // one lock per call, so lines from different tasks rarely interleave
+        std::lock_guard<std::mutex> lock(mutex);
+        return fwrite(buffer, 1, size, stdout);
+    }
+
+   private:
+    std::mutex mutex;
+};
+
+inline HardwareSerial Serial;
+
+// FreeRTOS
+
+typedef std::mutex* SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef void* TaskHandle_t;
+
+const int pdTRUE = 1;
+const unsigned long portMAX_DELAY = 0xffffffff;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::mutex(); }
+
+// always waits forever, which is the only way rockets_client uses it
+inline int xSemaphoreTake(SemaphoreHandle_t mutex, unsigned long ticks) {
+    mutex->lock();
+    return pdTRUE;
+}
+
+inline int xSemaphoreGive(SemaphoreHandle_t mutex) {
+    mutex->unlock();
+    return pdTRUE;
+}
+
+inline int xTaskCreatePinnedToCore(TaskFunction_t task, const char* name,
+                                   uint32_t stackDepth, void* parameters,
+                                   int priority, TaskHandle_t* handle,
+                                   int coreId) {
+    std::thread(task, parameters).detach();
+    return pdTRUE;
+}
+
+#endif  // ARDUINO_H_
@@ -0,0 +1,162 @@
+#ifndef WIFI_H_
+#define WIFI_H_
+
+// WiFiClient on top of POSIX sockets, behaving like the ESP32 one where
+// rockets_client relies on it: connected() stays true while unread data is
+// buffered, and writes are sent as they are made (Nagle included), so the
+// packets on the wire match the device's.
+
+#include <Arduino.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS; the caller should ignore SIGPIPE instead
+#endif
+
+typedef enum {
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class WiFiClient : public Print {
+   public:
+    WiFiClient() {}
+    WiFiClient(const WiFiClient&) = delete;
+    WiFiClient& operator=(const WiFiClient&) = delete;
+    ~WiFiClient() { stop(); }
+
+    // Returns 1 if connected.
+    int connect(const char* host, uint16_t port) {
+        stop();
+
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        struct addrinfo* addrs;
+        String portStr(port);
+        if (getaddrinfo(host, portStr.c_str(), &hints, &addrs) != 0) {
+            return 0;
+        }
+
+        for (struct addrinfo* addr = addrs; addr != NULL;
+             addr = addr->ai_next) {
+            fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+            if (::connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+                break;
+            }
+            ::close(fd);
+            fd = -1;
+        }
+
+        freeaddrinfo(addrs);
+        return fd >= 0 ? 1 : 0;
+    }
+
+    // Adopts an already connected socket, e.g. one end of a socketpair() in
+    // the tests.
+    void attach(int fd) {
+        stop();
+        this->fd = fd;
+    }
+
+    uint8_t connected() {
+        if (available() > 0) {
+            return 1;
+        }
+        return fd >= 0 ? 1 : 0;
+    }
+
+    // Number of bytes that can be read without blocking.
+    int available() {
+        if (bufferPos < bufferLen) {
+            return bufferLen - bufferPos;
+        }
+        if (fd < 0) {
+            return 0;
+        }
+
+        ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0) {
+            bufferPos = 0;
+            bufferLen = n;
+            return n;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            // closed by the peer, or broken
+            ::close(fd);
+            fd = -1;
+        }
+        return 0;
+    }
+
+    // Returns the next byte, or -1 if none is available.
+    int read() {
+        if (available() <= 0) {
+            return -1;
+        }
+        return buffer[bufferPos++];
+    }
+
+    size_t write(const uint8_t* data, size_t size) override {
+        if (fd < 0) {
+            return 0;
+        }
+
+        size_t sent = 0;
+        while (sent < size) {
+            ssize_t n = send(fd, data + sent, size - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                stop();
+                break;
+            }
+            sent += n;
+        }
+        return sent;
+    }
+
+    void setNoDelay(bool noDelay) {
+        int flag = noDelay ? 1 : 0;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    }
+
+    // The ESP32 client uses this for blocking reads; rockets_client doesn't
+    // do any.
+    void setTimeout(int seconds) {}
+
+    void stop() {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        bufferPos = bufferLen = 0;
+    }
+
+   private:
+    int fd = -1;
+    uint8_t buffer[1460];
+    size_t bufferPos = 0;
+    size_t bufferLen = 0;
+};
+
+// Always connected; the host's network stands in for Wi-Fi.
+class WiFiClass {
+   public:
+    void setAutoReconnect(bool autoReconnect) {}
+    void begin(const String& ssid, const String& password) {}
+    wl_status_t status() { return WL_CONNECTED; }
+    String localIP() { return "127.0.0.1"; }
+};
+
+inline WiFiClass WiFi;
+
+#endif  // WIFI_H_
@@ -0,0 +1,243 @@
+"""
+Local stand-in for the data server, for exercising rockets_client without the
+real thing. Implements the subset of the API the client uses, keeps everything
+in memory, and accepts record uploads as either JSON or MessagePack.
+
+Messages can be sent to a device with, e.g.:
+    curl -X POST localhost:3000/messages \
+        -d '{"environmentKey": "0", "device": "FiringStation", "data": {"command": "abort"}}'
+
+GET /messages/next supports long polling: with `waitMs`, the request is held
+open until a message arrives or the wait runs out.
+
+The host build of the client (see the Makefile) runs against this.
+
+Usage: python stand_in_server.py [port]
+"""
+
+import json
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from typing import Any
+from urllib.parse import parse_qs, urlparse
+
+# (environmentKey, device) -> records, oldest first
+records: dict[tuple[str, str], list[Any]] = {}
+records_lock = threading.Lock()
+
+# (environmentKey, device) -> messages, oldest first
+messages: dict[tuple[str, str], list[Any]] = {}
+# notified whenever a message is added
+messages_cond = threading.Condition()
+
+# count of bytes received per content type, to compare encodings
+body_bytes: dict[str, int] = {}
+
+
+def now_us() -> int:
+    return time.time_ns() // 1000
+
+
+def next_message(key: tuple[str, str], after_ts: int) -> Any | None:
+    # caller must hold messages_cond
+    for message in messages.get(key, []):
+        if message["ts"] > after_ts:
+            return message
+    return None
+
+
+def wait_for_message(key: tuple[str, str], after_ts: int, wait_ms: int) -> Any | None:
+    deadline = time.monotonic() + wait_ms / 1000
+
+    with messages_cond:
+        while True:
+            message = next_message(key, after_ts)
+            remaining = deadline - time.monotonic()
+            if message is not None or remaining <= 0:
+                return message
+            messages_cond.wait(remaining)
+
+
+def decode_msgpack(data: bytes) -> Any:
+    """Decodes the subset of MessagePack that ArduinoJson produces."""
+
+    def read(i: int) -> tuple[Any, int]:
+        b = data[i]
+        i += 1
+
+        if b <= 0x7F:
+            return b, i
+        if b >= 0xE0:
+            return b - 0x100, i
+        if 0x80 <= b <= 0x8F:
+            return read_map(i, b & 0x0F)
+        if 0x90 <= b <= 0x9F:
+            return read_array(i, b & 0x0F)
+        if 0xA0 <= b <= 0xBF:
+            return read_str(i, b & 0x1F)
+
+        if b == 0xC0:
+            return None, i
+        if b == 0xC2:
+            return False, i
+        if b == 0xC3:
+            return True, i
+
+        fixed = {
+            0xCA: ">f",
+            0xCB: ">d",
+            0xCC: ">B",
+            0xCD: ">H",
+            0xCE: ">I",
+            0xCF: ">Q",
+            0xD0: ">b",
+            0xD1: ">h",
+            0xD2: ">i",
+            0xD3: ">q",
+        }
+        if b in fixed:
+            fmt = fixed[b]
+            size = struct.calcsize(fmt)
+            return struct.unpack_from(fmt, data, i)[0], i + size
+
+        if b == 0xD9:
+            return read_str(i + 1, data[i])
+        if b == 0xDA:
+            return read_str(i + 2, struct.unpack_from(">H", data, i)[0])
+        if b == 0xDC:
+            return read_array(i + 2, struct.unpack_from(">H", data, i)[0])
+        if b == 0xDE:
+            return read_map(i + 2, struct.unpack_from(">H", data, i)[0])
+
+        raise ValueError(f"Unsupported MessagePack type 0x{b:02x}")
+
+    def read_str(i: int, n: int) -> tuple[str, int]:
+        return data[i : i + n].decode("utf-8"), i + n
+
+    def read_array(i: int, n: int) -> tuple[list[Any], int]:
+        result = []
+        for _ in range(n):
+            value, i = read(i)
+            result.append(value)
+        return result, i
+
+    def read_map(i: int, n: int) -> tuple[dict[Any, Any], int]:
+        result = {}
+        for _ in range(n):
+            key, i = read(i)
+            value, i = read(i)
+            result[key] = value
+        return result, i
+
+    value, end = read(0)
+    if end != len(data):
+        raise ValueError("Trailing bytes after MessagePack value")
+    return value
+
+
+class Handler(BaseHTTPRequestHandler):
+    # keep-alive, like the real server
+    protocol_version = "HTTP/1.1"
+    # the head and body are written separately; without this the body waits
+    # for the client's delayed ack of the head
+    disable_nagle_algorithm = True
+
+    def log_message(self, format: str, *args: Any):
+        pass  # too noisy at the rates the client runs at
+
+    def send_body(self, status: int, body: str):
+        encoded = body.encode("utf-8")
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(encoded)))
+        self.end_headers()
+        self.wfile.write(encoded)
+
+    def read_body(self) -> Any:
+        length = int(self.headers.get("Content-Length", 0))
+        data = self.rfile.read(length)
+
+        content_type = self.headers.get("Content-Type", "application/json")
+        body_bytes[content_type] = body_bytes.get(content_type, 0) + length
+
+        if content_type == "application/msgpack":
+            return decode_msgpack(data)
+        return json.loads(data)
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        query = {k: v[0] for k, v in parse_qs(url.query).items()}
+
+        if url.path == "/ts":
+            self.send_body(200, str(now_us()))
+        elif url.path == "/records/multiDevice":
+            result = {}
+            with records_lock:
+                for device in query.get("devices", "").split(","):
+                    device_records = records.get((query["environmentKey"], device))
+                    result[device] = device_records[-1] if device_records else None
+            self.send_body(200, json.dumps(result))
+        elif url.path == "/messages/next":
+            key = (query["environmentKey"], query["device"])
+            message = wait_for_message(
+                key, int(query["afterTs"]), int(query.get("waitMs", 0))
+            )
+            if message is None:
+                self.send_body(200, "NONE")
+            else:
+                self.send_body(200, json.dumps(message))
+        else:
+            self.send_body(404, "Not found")
+
+    def do_POST(self):
+        url = urlparse(self.path)
+
+        try:
+            body = self.read_body()
+        except ValueError as e:
+            self.send_body(400, f"Bad body: {e}")
+            return
+
+        if url.path == "/messages":
+            key = (body["environmentKey"], body["device"])
+            with messages_cond:
+                messages.setdefault(key, []).append(
+                    {"ts": now_us(), "data": body["data"]}
+                )
+                messages_cond.notify_all()
+            self.send_body(200, "")
+            return
+
+        if url.path == "/records":
+            batch = [{"ts": body["ts"], "data": body["data"]}]
+        elif url.path == "/records/batch":
+            batch = body["records"]
+        else:
+            self.send_body(404, "Not found")
+            return
+
+        key = (body["environmentKey"], body["device"])
+        with records_lock:
+            records.setdefault(key, []).extend(batch)
+
+        self.send_body(200, "")
+
+
+def print_stats():
+    while True:
+        time.sleep(5)
+        with records_lock:
+            counts = {f"{env}/{dev}": len(r) for (env, dev), r in records.items()}
+        print(f"Records: {counts}, body bytes: {body_bytes}", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 3000
+
+    threading.Thread(target=print_stats, daemon=True).start()
+
+    print(f"Listening on port {port}", file=sys.stderr)
+    ThreadingHTTPServer(("", port), Handler).serve_forever()
@@ -0,0 +1,466 @@
+// Tests for the parts of rockets_client that can be checked without a server:
+// HttpResponse against canned responses, delivered whole and in pieces,
+// ClockSync against a synthetic server clock, and RecordQueue. Exits with a
+// non-zero status if any check fails. See the Makefile for how to build and
+// run it.
+
+#include <clock_sync.h>
+#include <http_response.h>
+#include <record_queue.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using rockets_client::ClockSync;
+using rockets_client::HttpResponse;
+using rockets_client::RecordQueue;
+
+int failures = 0;
+
+#define CHECK(condition)                                                \
+    do {                                                                \
+        if (!(condition)) {                                             \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__,     \
+                   #condition);                                         \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+// HttpResponse
+
+// A WiFiClient connected to a socket that the test writes the server side of.
+struct FakeServer {
+    WiFiClient client;
+    int serverFd = -1;
+
+    FakeServer() {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        client.attach(fds[0]);
+        serverFd = fds[1];
+    }
+
+    ~FakeServer() { close(); }
+
+    void send(const std::string& data) {
+        ::send(serverFd, data.data(), data.size(), 0);
+    }
+
+    // Sends `pieces` one at a time from another thread, `gapMs` apart, so
+    // the client reads each separately.
+    std::thread sendSlowly(std::vector<std::string> pieces, int gapMs) {
+        return std::thread([=]() {
+            for (const std::string& piece : pieces) {
+                delay(gapMs);
+                send(piece);
+            }
+        });
+    }
+
+    void close() {
+        if (serverFd >= 0) {
+            ::close(serverFd);
+            serverFd = -1;
+        }
+    }
+};
+
+std::string readBody(HttpResponse& res) {
+    std::string body;
+    int c;
+    while ((c = res.read()) >= 0) {
+        body += (char)c;
+    }
+    return body;
+}
+
+void testContentLength() {
+    FakeServer server;
+    server.send(
+        "HTTP/1.1 200 OK\r\n"
+        "content-length: 5\r\n"
+        "\r\n"
+        "hello"
+        "HTTP/1.1 404 Not Found\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n");
+
+    // two pipelined responses on one connection
+    HttpResponse first(server.client, 1000);
+    CHECK(first.readHead());
+    CHECK(first.getStatus() == 200);
+    CHECK(first.peek() == 'h');
+    CHECK(readBody(first) == "hello");
+    CHECK(first.finish());
+    CHECK(first.canReuseConnection());
+
+    HttpResponse second(server.client, 1000);
+    CHECK(second.readHead());
+    CHECK(second.getStatus() == 404);
+    CHECK(readBody(second) == "");
+    CHECK(second.finish());
+    CHECK(second.canReuseConnection());
+}
+
+void testChunked() {
+    FakeServer server;
+    server.send(
+        "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "5\r\nhello\r\n"
+        "7\r\n, world\r\n"
+        "0\r\n"
+        "X-Trailer: 1\r\n"
+        "\r\n");
+
+    HttpResponse res(server.client, 1000);
+    CHECK(res.readHead());
+    CHECK(readBody(res) == "hello, world");
+    CHECK(res.finish());
+    CHECK(res.canReuseConnection());
+}
+
+void testChunkedSplitReads() {
+    FakeServer server;
+    // split inside the status line, a header, a chunk size, chunk data and
+    // the CRLF after a chunk
+    std::thread sender = server.sendSlowly(
+        {"HTTP/1.", "1 200 OK\r\nTransfer-Enc", "oding: chunked\r\n\r\n",
+         "1", "0\r\n0123456", "789abcdef\r", "\n3\r\nxyz\r\n0\r\n\r\n"},
+        5);
+
+    HttpResponse res(server.client, 1000);
+    CHECK(res.readHead());
+    CHECK(res.getStatus() == 200);
+    CHECK(readBody(res) == "0123456789abcdefxyz");
+    CHECK(res.finish());
+    CHECK(res.canReuseConnection());
+    CHECK(res.getBytesRead() == 82);
+
+    sender.join();
+}
+
+void testUntilClose() {
+    FakeServer server;
+    server.send(
+        "HTTP/1.1 200 OK\r\n"
+        "\r\n"
+        "no length");
+    server.close();
+
+    HttpResponse res(server.client, 1000);
+    CHECK(res.readHead());
+    CHECK(readBody(res) == "no length");
+    CHECK(res.finish());
+    CHECK(!res.canReuseConnection());
+}
+
+void testConnectionClose() {
+    FakeServer server;
+    server.send(
+        "HTTP/1.1 200 OK\r\n"
+        "Connection: close\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "ok");
+
+    HttpResponse res(server.client, 1000);
+    CHECK(res.readHead());
+    CHECK(readBody(res) == "ok");
+    CHECK(res.finish());
+    CHECK(!res.canReuseConnection());
+}
+
+void testTimeoutMidBody() {
+    FakeServer server;
+    server.send(
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 10\r\n"
+        "\r\n"
+        "abc");
+
+    HttpResponse res(server.client, 50);
+    CHECK(res.readHead());
+    CHECK(res.getStatus() == 200);
+    CHECK(readBody(res) == "abc");
+    CHECK(!res.finish());
+    CHECK(!res.canReuseConnection());
+}
+
+void testNoResponse() {
+    FakeServer server;
+
+    HttpResponse res(server.client, 50);
+    CHECK(!res.readHead());
+    CHECK(!res.gotAnyBytes());
+}
+
+void testMalformedStatusLine() {
+    FakeServer server;
+    server.send("garbage\r\n\r\n");
+
+    HttpResponse res(server.client, 1000);
+    CHECK(!res.readHead());
+    CHECK(res.gotAnyBytes());
+    CHECK(!res.canReuseConnection());
+}
+
+// ClockSync
+
+const int64_t SECOND_US = 1000 * 1000;
+
+// A server clock `offset` ahead of the local clock, running `drift` fast.
+struct ServerClock {
+    int64_t offset;
+    double drift;
+
+    int64_t at(int64_t local) const {
+        return local + offset + (int64_t)(drift * local);
+    }
+};
+
+// Adds a sample for a request sent at `localSend` with round trip `rtt`,
+// which the server answers `serverDelay` after it was sent.
+void addSample(ClockSync& sync, const ServerClock& server, int64_t localSend,
+               int64_t rtt, int64_t serverDelay) {
+    sync.addSample(localSend, localSend + rtt,
+                   server.at(localSend + serverDelay));
+}
+
+int64_t error(const ClockSync& sync, const ServerClock& server,
+              int64_t local) {
+    return llabs(sync.toServerTime(local) - server.at(local));
+}
+
+void testClockOffset() {
+    ClockSync sync;
+    ServerClock server = {5 * SECOND_US, 0};
+
+    CHECK(!sync.isSynced());
+    CHECK(!sync.apply(0, false));
+
+    // the asymmetric 4 ms round trip is the best; its error is at most 2 ms
+    int64_t t = SECOND_US;
+    addSample(sync, server, t, 20000, 10000);
+    addSample(sync, server, t + 50000, 4000, 1000);
+    addSample(sync, server, t + 100000, 30000, 15000);
+    CHECK(sync.getSampleCount() == 3);
+    CHECK(sync.getBestRtt() == 4000);
+
+    // the first apply steps, even without `step`
+    CHECK(sync.apply(t + 200000, false));
+    CHECK(sync.isSynced());
+    CHECK(sync.getSampleCount() == 0);
+    CHECK(error(sync, server, t + 200000) <= 2000);
+    CHECK(error(sync, server, t + 10 * SECOND_US) <= 2000);
+
+    // negative round trips are ignored
+    sync.addSample(t, t - 1, 0);
+    CHECK(sync.getSampleCount() == 0);
+}
+
+void testClockDrift() {
+    ClockSync sync;
+    ServerClock server = {-3 * SECOND_US, 0.0002};  // 200 ppm fast
+
+    addSample(sync, server, SECOND_US, 1000, 500);
+    sync.apply(SECOND_US, false);
+
+    // without a drift estimate yet, the error grows by 200 us per second
+    int64_t t = 11 * SECOND_US;
+    CHECK(error(sync, server, t) > 1900);
+
+    int64_t before = sync.toServerTime(t);
+    addSample(sync, server, t, 1000, 500);
+    CHECK(sync.apply(t, false));
+
+    // the 2 ms correction is slewed in, so time doesn't jump
+    CHECK(llabs(sync.toServerTime(t) - before) <= 1);
+    // and is fully in after 2 ms / MAX_SLEW_RATE = 2 s
+    CHECK(error(sync, server, t + SECOND_US) > 500);
+    CHECK(error(sync, server, t + 3 * SECOND_US) <= 10);
+    // then the drift keeps it on track
+    CHECK(error(sync, server, t + 60 * SECOND_US) <= 10);
+}
+
+void testClockSlewIsMonotonic() {
+    ClockSync sync;
+    ServerClock server = {0, 0};
+
+    addSample(sync, server, SECOND_US, 1000, 500);
+    sync.apply(SECOND_US, false);
+
+    // the server clock jumps back 50 ms, which is slewed, not stepped
+    server.offset = -50000;
+    int64_t t = 2 * SECOND_US;
+    addSample(sync, server, t, 1000, 500);
+    sync.apply(t, false);
+
+    int64_t last = sync.toServerTime(t);
+    for (int64_t local = t; local < t + 60 * SECOND_US; local += 10000) {
+        int64_t ts = sync.toServerTime(local);
+        CHECK(ts >= last);
+        last = ts;
+    }
+    CHECK(error(sync, server, t + 60 * SECOND_US) <= 10);
+}
+
+void testClockStep() {
+    ClockSync sync;
+    ServerClock server = {0, 0};
+
+    addSample(sync, server, SECOND_US, 1000, 500);
+    sync.apply(SECOND_US, false);
+
+    // larger than MAX_SLEW_US, so stepped at once
+    server.offset = 10 * SECOND_US;
+    int64_t t = 2 * SECOND_US;
+    addSample(sync, server, t, 1000, 500);
+    sync.apply(t, false);
+    CHECK(error(sync, server, t) <= 10);
+
+    // small, but stepped because asked to
+    server.offset += 20000;
+    t += SECOND_US;
+    addSample(sync, server, t, 1000, 500);
+    sync.apply(t, true);
+    CHECK(error(sync, server, t) <= 10);
+}
+
+void testClockDriftIsClamped() {
+    ClockSync sync;
+    ServerClock server = {0, 0.002};  // 2000 ppm, past MAX_DRIFT
+
+    addSample(sync, server, SECOND_US, 1000, 500);
+    sync.apply(SECOND_US, true);
+    int64_t t = 11 * SECOND_US;
+    addSample(sync, server, t, 1000, 500);
+    sync.apply(t, true);
+
+    // extrapolated at MAX_DRIFT rather than the measured drift
+    int64_t later = t + 10 * SECOND_US;
+    int64_t extrapolated = sync.toServerTime(later) - sync.toServerTime(t);
+    CHECK(llabs(extrapolated - (int64_t)(10 * SECOND_US *
+                                         (1 + ClockSync::MAX_DRIFT))) <= 10);
+}
+
+// RecordQueue
+
+// Queues `record`, as queueRecord() does. Returns false if it didn't fit.
+template <size_t Capacity>
+bool push(RecordQueue<Capacity>& queue, const std::string& record) {
+    char* dest = queue.beginPush(record.size());
+    if (dest == NULL) {
+        return false;
+    }
+    memcpy(dest, record.c_str(), record.size() + 1);
+    queue.commitPush(record.size());
+    return true;
+}
+
+// The queued records, oldest first; sets `end` to the position after them.
+template <size_t Capacity>
+std::vector<std::string> peekAll(const RecordQueue<Capacity>& queue,
+                                 uint32_t& end) {
+    std::vector<std::string> records;
+    end = queue.begin();
+    const char* record;
+    size_t len;
+    while ((record = queue.peek(end, len)) != NULL) {
+        CHECK(record[len] == '\0');
+        records.push_back(std::string(record, len));
+    }
+    return records;
+}
+
+void testRecordQueue() {
+    RecordQueue<64> queue;
+    uint32_t end;
+
+    // nothing is reserved until allocate()
+    CHECK(!push(queue, "a"));
+    CHECK(queue.allocate());
+    CHECK(queue.allocate());
+
+    // records of 4 + 8 bytes, with the null terminator and padding
+    CHECK(push(queue, "1234567"));
+    CHECK(push(queue, "abc"));
+    CHECK(peekAll(queue, end) == std::vector<std::string>({"1234567", "abc"}));
+
+    // peeking doesn't pop
+    CHECK(peekAll(queue, end).size() == 2);
+
+    // pop the first only
+    uint32_t pos = queue.begin();
+    size_t len;
+    queue.peek(pos, len);
+    queue.popTo(pos);
+    CHECK(peekAll(queue, end) == std::vector<std::string>({"abc"}));
+
+    // "abc" takes up 12 to 20; fill up to the end of the ring exactly
+    CHECK(push(queue, std::string(39, 'x')));
+    CHECK(!push(queue, std::string(12, 'y')));  // would overwrite "abc"
+    queue.popTo(queue.begin() + 8);
+    CHECK(push(queue, std::string(12, 'y')));  // from the start of the ring
+    std::vector<std::string> expected = {std::string(39, 'x'),
+                                         std::string(12, 'y')};
+    CHECK(peekAll(queue, end) == expected);
+    queue.popTo(end);
+    CHECK(peekAll(queue, end).empty());
+
+    // empty at 20; a record up to 60, and one that doesn't fit in the 4 bytes
+    // after it, so goes after a skip marker at the start of the ring
+    CHECK(push(queue, std::string(35, 'x')));
+    queue.popTo(queue.begin() + 40);
+    CHECK(push(queue, std::string(11, 'w')));
+    CHECK(peekAll(queue, end) ==
+          std::vector<std::string>({std::string(11, 'w')}));
+    queue.popTo(end);
+
+    // too large for the ring at all
+    CHECK(!push(queue, std::string(60, 'z')));
+
+    // many times around the ring, with a backlog
+    expected.clear();
+    for (int i = 0; i < 1000; i++) {
+        std::string record(i % 13, 'a' + i % 26);
+        while (!push(queue, record)) {
+            pos = queue.begin();
+            const char* oldest = queue.peek(pos, len);
+            CHECK(oldest != NULL && std::string(oldest, len) == expected[0]);
+            queue.popTo(pos);
+            expected.erase(expected.begin());
+        }
+        expected.push_back(record);
+    }
+    CHECK(peekAll(queue, end) == expected);
+}
+
+int main() {
+    testContentLength();
+    testChunked();
+    testChunkedSplitReads();
+    testUntilClose();
+    testConnectionClose();
+    testTimeoutMidBody();
+    testNoResponse();
+    testMalformedStatusLine();
+
+    testClockOffset();
+    testClockDrift();
+    testClockSlewIsMonotonic();
+    testClockStep();
+    testClockDriftIsClamped();
+
+    testRecordQueue();
+
+    if (failures > 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All tests passed\n");
+    return 0;
+}
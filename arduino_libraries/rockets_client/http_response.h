@@ -0,0 +1,254 @@
+#ifndef HTTP_RESPONSE_H_
+#define HTTP_RESPONSE_H_
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+namespace rockets_client {
+
+// Incremental parser for one HTTP/1.1 response, read straight off the socket.
+// readHead() consumes the status line and headers; the body can then be
+// consumed with read()/readBytes(), which makes this usable as an ArduinoJson
+// reader, e.g. `deserializeJson(doc, res)`. Content-Length, chunked and
+// read-until-close bodies are supported. Nothing is buffered beyond one header
+// line, so there is no limit on the body size.
+class HttpResponse {
+   public:
+    HttpResponse(WiFiClient& client, unsigned long timeoutMs)
+        : client(client), timeoutMs(timeoutMs), startTime(millis()) {}
+
+    // Returns true if the status line and headers were read. If nothing at all
+    // was received, gotAnyBytes() is false.
+    bool readHead() {
+        char line[128];
+
+        if (!readLine(line, sizeof(line))) {
+            return false;
+        }
+        if (sscanf(line, "HTTP/1.1 %d", &status) != 1) {
+            failed = true;
+            return false;
+        }
+
+        bool hasLength = false;
+
+        while (true) {
+            if (!readLine(line, sizeof(line))) {
+                return false;
+            }
+            if (line[0] == '\0') {
+                break;  // empty line marks the end of the headers
+            }
+
+            const char* value;
+            if ((value = headerValue(line, "Content-Length")) != NULL) {
+                remaining = strtol(value, NULL, 10);
+                hasLength = true;
+            } else if ((value = headerValue(line, "Transfer-Encoding")) !=
+                       NULL) {
+                chunked = strncasecmp(value, "chunked", 7) == 0;
+            } else if ((value = headerValue(line, "Connection")) != NULL) {
+                if (strncasecmp(value, "close", 5) == 0) {
+                    keepAlive = false;
+                }
+            }
+        }
+
+        if (chunked) {
+            remaining = 0;  // the first chunk header hasn't been read yet
+        } else if (!hasLength) {
+            // the body ends when the server closes the socket
+            untilClose = true;
+            keepAlive = false;
+        }
+
+        return true;
+    }
+
+    int getStatus() const { return status; }
+
+    // False if the server asked to close the connection, or if the response
+    // wasn't read cleanly to the end.
+    bool canReuseConnection() const { return keepAlive && !failed && done; }
+
+    bool gotAnyBytes() const { return gotAny; }
+
+    // esp_timer_get_time() when the first byte arrived, if gotAnyBytes()
+    int64_t getFirstByteTs() const { return firstByteTs; }
+
+    // bytes read off the socket so far, including the head
+    size_t getBytesRead() const { return bytesRead; }
+
+    // Returns the next body byte without consuming it, or -1 at the end.
+    int peek() {
+        if (peeked < 0) {
+            peeked = readBodyByte();
+        }
+        return peeked;
+    }
+
+    // Returns the next body byte, or -1 at the end of the body (or on error).
+    int read() {
+        int c = peek();
+        peeked = -1;
+        return c;
+    }
+
+    size_t readBytes(char* buffer, size_t length) {
+        size_t n = 0;
+        while (n < length) {
+            int c = read();
+            if (c < 0) {
+                break;
+            }
+            buffer[n++] = c;
+        }
+        return n;
+    }
+
+    // Copies at most `size - 1` body bytes into `dest` and null terminates.
+    void readBody(char* dest, size_t size) {
+        size_t n = readBytes(dest, size - 1);
+        dest[n] = '\0';
+    }
+
+    // Discards whatever is left of the body. Returns true if the whole
+    // response was received.
+    bool finish() {
+        while (read() >= 0)
+            ;
+        return !failed;
+    }
+
+   private:
+    WiFiClient& client;
+    const unsigned long timeoutMs;
+    const unsigned long startTime;
+
+    int status = 0;
+    bool keepAlive = true;
+    bool gotAny = false;
+    bool failed = false;
+    bool done = false;
+    int64_t firstByteTs = 0;
+    size_t bytesRead = 0;
+
+    bool chunked = false;
+    bool gotChunk = false;
+    bool untilClose = false;
+    long remaining = 0;  // bytes left in the body, or in the current chunk
+    int peeked = -1;
+
+    // returns the next byte on the socket, or -1 on timeout or disconnect
+    int timedRead() {
+        while (!client.available()) {
+            if (!client.connected() || millis() - startTime > timeoutMs) {
+                return -1;
+            }
+            yield();
+        }
+        if (!gotAny) {
+            gotAny = true;
+            firstByteTs = esp_timer_get_time();
+        }
+        bytesRead++;
+        return client.read();
+    }
+
+    // Reads a CRLF-terminated line without the CRLF, truncating long lines.
+    // Returns false (and marks the response failed) on timeout.
+    bool readLine(char* dest, size_t size) {
+        size_t i = 0;
+        while (true) {
+            int c = timedRead();
+            if (c < 0) {
+                failed = true;
+                return false;
+            }
+            if (c == '\n') {
+                break;
+            }
+            if (c != '\r' && i < size - 1) {
+                dest[i++] = c;
+            }
+        }
+        dest[i] = '\0';
+        return true;
+    }
+
+    // Returns a pointer to the value if `line` is header `name`, else NULL.
+    // Header names are case-insensitive.
+    static const char* headerValue(const char* line, const char* name) {
+        size_t nameLen = strlen(name);
+        if (strncasecmp(line, name, nameLen) != 0 || line[nameLen] != ':') {
+            return NULL;
+        }
+        const char* value = line + nameLen + 1;
+        while (*value == ' ') {
+            value++;
+        }
+        return value;
+    }
+
+    // Reads the next chunk header. Returns false at the last chunk.
+    bool nextChunk() {
+        char line[32];
+
+        if (remaining == 0 && gotChunk) {
+            // the previous chunk's data is followed by a CRLF
+            if (!readLine(line, sizeof(line))) {
+                return false;
+            }
+        }
+        gotChunk = true;
+
+        if (!readLine(line, sizeof(line))) {
+            return false;
+        }
+        remaining = strtol(line, NULL, 16);
+
+        if (remaining == 0) {
+            // skip trailers, up to and including the empty line
+            do {
+                if (!readLine(line, sizeof(line))) {
+                    return false;
+                }
+            } while (line[0] != '\0');
+            return false;
+        }
+        return true;
+    }
+
+    int readBodyByte() {
+        if (done || failed) {
+            return -1;
+        }
+
+        if (untilClose) {
+            int c = timedRead();
+            if (c < 0) {
+                // a closed socket is the expected end; a timeout isn't
+                failed = client.connected();
+                done = true;
+            }
+            return c;
+        }
+
+        if (remaining == 0 && (!chunked || !nextChunk())) {
+            done = true;
+            return -1;
+        }
+
+        int c = timedRead();
+        if (c < 0) {
+            failed = true;
+            return -1;
+        }
+        remaining--;
+        return c;
+    }
+};
+
+}  // namespace rockets_client
+
+#endif  // HTTP_RESPONSE_H_
@@ -0,0 +1,132 @@
+#ifndef NET_METRICS_H_
+#define NET_METRICS_H_
+
+#include <Arduino.h>
+
+namespace rockets_client {
+
+// Server endpoints the client talks to, for per-endpoint metrics.
+enum class Endpoint {
+    ts,                  // GET /ts
+    recordsBatch,        // POST /records/batch
+    messagesNext,        // GET /messages/next
+    recordsMultiDevice,  // GET /records/multiDevice
+};
+
+const int ENDPOINT_COUNT = 4;
+
+// Power-of-two millisecond buckets: bucket 0 counts latencies under 1 ms,
+// bucket i latencies in [2^(i-1), 2^i) ms, and the last bucket everything
+// from 2^(LATENCY_BUCKETS - 2) ms up.
+const int LATENCY_BUCKETS = 15;
+
+struct LatencyHistogram {
+    uint32_t buckets[LATENCY_BUCKETS];
+    uint32_t count;
+    uint64_t totalUs;
+    uint32_t maxUs;
+
+    void add(int64_t us) {
+        if (us < 0) {
+            us = 0;
+        }
+
+        uint32_t ms = us / 1000;
+        int bucket = 0;
+        while (ms > 0 && bucket < LATENCY_BUCKETS - 1) {
+            ms >>= 1;
+            bucket++;
+        }
+
+        buckets[bucket]++;
+        count++;
+        totalUs += us;
+        if (us > maxUs) {
+            maxUs = us;
+        }
+    }
+
+    // Upper bound of the bucket holding the `p`th fraction of samples (e.g.
+    // 0.99), in ms, capped at the max. Returns 0 if empty.
+    uint32_t percentileMs(float p) const {
+        uint32_t target = ceilf(count * p);
+        uint32_t seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+            seen += buckets[i];
+            if (seen >= target && seen > 0) {
+                uint32_t bound = 1UL << i;
+                return bound < maxMs() ? bound : maxMs();
+            }
+        }
+        return maxMs();
+    }
+
+    // rounded up, so that it's never below a percentile
+    uint32_t maxMs() const { return (maxUs + 999) / 1000; }
+
+    uint32_t meanMs() const { return count == 0 ? 0 : totalUs / count / 1000; }
+};
+
+struct EndpointStats {
+    // requests made, counted once even if retried on a stale connection;
+    // every one ends up as a status, timeout or connect failure
+    uint32_t requests;
+    // a reused connection turned out to be closed by the server and the
+    // request was retried on a new one; not counted as a failure
+    uint32_t staleRetries;
+    uint32_t connectFailures;  // couldn't connect; usually Wi-Fi or DNS
+    // connected but no complete response within the timeout
+    uint32_t timeouts;
+    uint32_t status2xx;
+    uint32_t status4xx;
+    uint32_t status5xx;
+    uint32_t statusOther;
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+
+    LatencyHistogram connect;    // opening a new connection
+    LatencyHistogram firstByte;  // from sending to the first response byte
+    LatencyHistogram total;      // from sending to the end of the response
+};
+
+// Per-endpoint request metrics. Not thread safe.
+class NetMetrics {
+   public:
+    static const char* endpointPath(Endpoint endpoint) {
+        switch (endpoint) {
+            case Endpoint::ts:
+                return "/ts";
+            case Endpoint::recordsBatch:
+                return "/records/batch";
+            case Endpoint::messagesNext:
+                return "/messages/next";
+            case Endpoint::recordsMultiDevice:
+                return "/records/multiDevice";
+        }
+        return "";
+    }
+
+    EndpointStats& operator[](Endpoint endpoint) {
+        return stats[(int)endpoint];
+    }
+
+    void addStatus(Endpoint endpoint, int status) {
+        EndpointStats& s = (*this)[endpoint];
+        if (status >= 200 && status < 300) {
+            s.status2xx++;
+        } else if (status >= 400 && status < 500) {
+            s.status4xx++;
+        } else if (status >= 500 && status < 600) {
+            s.status5xx++;
+        } else {
+            s.statusOther++;
+        }
+    }
+
+   private:
+    EndpointStats stats[ENDPOINT_COUNT] = {};
+};
+
+}  // namespace rockets_client
+
+#endif  // NET_METRICS_H_
@@ -0,0 +1,122 @@
+#ifndef RECORD_QUEUE_H_
+#define RECORD_QUEUE_H_
+
+#include <Arduino.h>
+
+#include <atomic>
+
+namespace rockets_client {
+
+// Lock-free single-producer single-consumer queue of serialized records,
+// stored back to back in a ring of Capacity bytes, so a small record only
+// takes up its own size. The ring is allocated by allocate(), so nothing is
+// reserved by a client that never queues a record, and nothing is allocated
+// after that. The producer fills a record in place and then commits it; the
+// consumer can peek at any number of queued records and only pops them once
+// they have been delivered.
+template <size_t Capacity>
+class RecordQueue {
+    static_assert(Capacity >= 64 && (Capacity & (Capacity - 1)) == 0,
+                  "Capacity must be a power of two");
+
+   public:
+    // Producer only. Allocates the ring if it hasn't been yet. Returns false
+    // if there isn't enough memory.
+    bool allocate() {
+        if (buffer == NULL) {
+            buffer = (char*)malloc(Capacity);
+        }
+        return buffer != NULL;
+    }
+
+    // Producer only. Returns contiguous room for a record of up to `maxLen`
+    // bytes, or NULL if the queue is too full or not allocated. The record
+    // isn't visible to the consumer until commitPush() is called.
+    char* beginPush(size_t maxLen) {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        uint32_t tail = this->tail.load(std::memory_order_acquire);
+
+        // a record that would run past the end of the ring starts over at
+        // the beginning, after a marker telling the consumer to skip there
+        size_t index = head % Capacity;
+        size_t size = recordSize(maxLen);
+        size_t skip = index + size > Capacity ? Capacity - index : 0;
+
+        if (buffer == NULL || head - tail + skip + size > Capacity) {
+            return NULL;
+        }
+        pushSkip = skip;
+        return buffer + (index + skip) % Capacity + HEADER_SIZE;
+    }
+
+    // Producer only. `len` excludes the null terminator, and must be at most
+    // the `maxLen` passed to beginPush().
+    void commitPush(size_t len) {
+        uint32_t head = this->head.load(std::memory_order_relaxed);
+        if (pushSkip > 0) {
+            putLen(head % Capacity, WRAP);
+            head += pushSkip;
+        }
+        putLen(head % Capacity, len);
+        this->head.store(head + recordSize(len), std::memory_order_release);
+    }
+
+    // Consumer only. Position of the oldest queued record, for peek().
+    uint32_t begin() const { return tail.load(std::memory_order_relaxed); }
+
+    // Consumer only. Returns the record at `pos`, which must be begin() or
+    // where an earlier peek() left it, and moves `pos` to the next record.
+    // Returns NULL if there are no more records.
+    const char* peek(uint32_t& pos, size_t& len) const {
+        if (pos == head.load(std::memory_order_acquire)) {
+            return NULL;
+        }
+
+        uint32_t recordLen = getLen(pos % Capacity);
+        if (recordLen == WRAP) {
+            pos += Capacity - pos % Capacity;
+            recordLen = getLen(0);
+        }
+
+        const char* record = buffer + pos % Capacity + HEADER_SIZE;
+        len = recordLen;
+        pos += recordSize(recordLen);
+        return record;
+    }
+
+    // Consumer only. Frees the records before `pos`, a position from peek().
+    void popTo(uint32_t pos) { tail.store(pos, std::memory_order_release); }
+
+   private:
+    // each record is its length, then the record, padded so the next length
+    // is aligned
+    static const size_t HEADER_SIZE = sizeof(uint32_t);
+    static const uint32_t WRAP = UINT32_MAX;  // a length meaning "see index 0"
+
+    char* buffer = NULL;
+    size_t pushSkip = 0;  // between beginPush() and commitPush()
+
+    // free-running byte positions; only their difference matters
+    std::atomic<uint32_t> head{0};  // written by producer
+    std::atomic<uint32_t> tail{0};  // written by consumer
+
+    // including the header, the null terminator and padding
+    static size_t recordSize(size_t len) {
+        return HEADER_SIZE +
+               (len + 1 + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+    }
+
+    void putLen(size_t index, uint32_t len) {
+        memcpy(buffer + index, &len, HEADER_SIZE);
+    }
+
+    uint32_t getLen(size_t index) const {
+        uint32_t len;
+        memcpy(&len, buffer + index, HEADER_SIZE);
+        return len;
+    }
+};
+
+}  // namespace rockets_client
+
+#endif  // RECORD_QUEUE_H_
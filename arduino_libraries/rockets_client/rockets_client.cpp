@@ -2,7 +2,11 @@
 
 #include <WiFi.h>
 
+#include "clock_sync.h"
+#include "doc_snapshot.h"
 #include "frequency_logger.h"
+#include "http_response.h"
+#include "record_queue.h"
 
 namespace rockets_client {
 
@@ -29,42 +33,101 @@ ServerConfigPresets serverConfigPresets = {
             .host = "fs-pi.local",
             .port = 3000,
             .pathPrefix = "",
+            .keepAlive = true,
+            .recordEncoding = RecordEncoding::json,
+            .messageWaitMs = 5000,
         },
     .ROCKET_PI =
         {
             .host = "rocket-pi.local",
             .port = 3000,
             .pathPrefix = "",
+            .keepAlive = true,
+            .recordEncoding = RecordEncoding::json,
+            .messageWaitMs = 0,
         },
     .MECHE =
         {
             .host = "csiwiki.me.columbia.edu",
             .port = 3001,
             .pathPrefix = "/rocketsdata2",
+            .keepAlive = false,
+            .recordEncoding = RecordEncoding::json,
+            .messageWaitMs = 0,
         },
     .ALEX_LAPTOP =
         {
             .host = "csi-alex-laptop-data-server.ngrok.io",
             .port = 80,
             .pathPrefix = "",
+            .keepAlive = false,
+            .recordEncoding = RecordEncoding::json,
+            .messageWaitMs = 0,
         },
     .ALEX_HOME_DESKTOP =
         {
             .host = "xdxdxdxdxd.mynetgear.com",
             .port = 3000,
             .pathPrefix = "",
+            .keepAlive = false,
+            .recordEncoding = RecordEncoding::json,
+            .messageWaitMs = 0,
         },
 };
 
 // general parameters
 
-const int64_t MAX_TS_DELAY_MS = 200;  // max allowed delay w.r.t. server time
+const int64_t MAX_TS_DELAY_MS = 200;  // warn if ts round trips exceed this
+
+// min time between two records carrying network stats
+const unsigned long NET_STATS_ATTACH_INTERVAL_MS = 1000;
+
+// pipeline parameters; each pipeline gets its own task and connection, and
+// waits for a response at most its timeout
+
+const unsigned long UPLOAD_TIMEOUT_MS = 3000;
+const unsigned long UPLOAD_INTERVAL_MS = 5;
+// wait before resending a batch the server failed with a 5xx
+const unsigned long UPLOAD_RETRY_DELAY_MS = 500;
+
+// commands should fail fast and be retried rather than wait on a dead request
+const unsigned long MESSAGES_TIMEOUT_MS = 1000;
+const unsigned long MESSAGES_INTERVAL_MS = 5;
+
+const unsigned long RECORDS_TIMEOUT_MS = 3000;
+const unsigned long RECORDS_INTERVAL_MS = 5;
+
+// ts sync parameters
+
+const int TS_SYNC_SAMPLE_COUNT = 8;  // round trips per sync; best one is used
+// the first sync holds up uploads until it has its samples, or gives up after
+// this many tries or this long and carries on unsynced
+const int TS_INITIAL_SYNC_MAX_ATTEMPTS = 3 * TS_SYNC_SAMPLE_COUNT;
+const unsigned long TS_INITIAL_SYNC_TIMEOUT_MS = 10 * 1000;
+const unsigned long TS_RESYNC_INTERVAL_MS = 30 * 1000;
+
+// record queue parameters
+
+// records are queued back to back, so this holds e.g. 60 records of 250 bytes;
+// must be a power of two
+const size_t RECORD_QUEUE_SIZE = 16 * 1024;
+// max serialized size of one record, plus its null terminator; a full
+// StaticJsonDoc serializes to well under this
+const size_t RECORD_SIZE = 2048;
+
+// a /records/batch body holds as many queued records as fit, the rest go in
+// the next batch
+const size_t BATCH_BODY_SIZE = 16 * 1024;
+const size_t BATCH_HEADER_SIZE = 256;  // environment key, device and framing
+
+static_assert(BATCH_BODY_SIZE >= BATCH_HEADER_SIZE + RECORD_SIZE + 2,
+              "a batch must fit at least one record");
 
 // task parameters
 
 const int CORE_ID = 0;
 const int PRIORITY = 0;
-const int STACK_DEPTH = 64 * 1000;  // 64 kB
+const int STACK_DEPTH = 16 * 1000;  // 16 kB per pipeline task
 
 // constants specific to this client
 
@@ -74,6 +137,9 @@ String WIFI_PASSWORD;
 String HOST;
 int PORT;
 String PATH_PREFIX;
+bool KEEP_ALIVE;
+RecordEncoding RECORD_ENCODING;
+unsigned long MESSAGE_WAIT_MS;
 
 String ENVIRONMENT_KEY;
 String DEVICE;
@@ -81,55 +147,171 @@ String DEVICE;
 bool POLL_MESSAGES;
 String POLL_RECORD_DEVICES;
 
-// for triggering ts sync
-bool syncTsRequested = false;
+// for attaching network stats to records; only accessed by the producer
+bool attachNetworkStats = false;
+unsigned long lastNetStatsAttachMillis = 0;
+
+// for triggering ts sync; set by the caller, cleared by the upload pipeline
+std::atomic<bool> syncTsRequested{false};
 
-// buffers for queued record and latest message
+// set once the upload pipeline has synced the clock for the first time
+std::atomic<bool> tsSynced{false};
+// set once the upload pipeline has tried the first sync; only accessed by it
+bool initialTsSyncTried = false;
 
-// length 0 if no record is queued
-Buffer queuedRecord = "";
-// empty if there is no new message since the last retrieval
-StaticJsonDoc latestMessage;
-// empty only at the beginning, before the first poll completes
-StaticJsonDoc latestRecords;
+// for background ts sync; only accessed by the upload pipeline
+int tsSamplesTaken = 0;
+unsigned long lastTsSyncMillis = 0;
+
+// buffers for queued records and latest message
+
+// both allocated by the first queueRecord(), see allocateRecordBuffers()
+RecordQueue<RECORD_QUEUE_SIZE> queuedRecords;
+// body of a /records/batch request
+char* batchBody = NULL;
+size_t batchBodyLen = 0;
+// written by the messages and records pipelines respectively
+DocSnapshot<StaticJsonDoc> latestMessage;
+DocSnapshot<StaticJsonDoc> latestRecords;
+
+// version of the last message returned by borrowLatestMessage() or
+// getLatestMessage(); only accessed by the consumer
+uint32_t lastReadMessageVersion = 0;
 
 // for uploading records
 
-// add this to esp_timer_get_time() to get the absolute timestamp
-int64_t absoluteTsOffset = 0;
+// maps esp_timer_get_time() to the absolute (server) timestamp
+ClockSync clockSync;
 
-// for fetching new messages
+// for fetching new messages; 0 until the clock is first synced
 
 int64_t lastMessageTs = 0;
 
-// mutexes for the buffers
+// record counters, updated by both the producer and the upload pipeline
 
-SemaphoreHandle_t queuedRecordMutex;
-SemaphoreHandle_t latestMessageMutex;
-SemaphoreHandle_t latestRecordsMutex;
+std::atomic<uint32_t> queuedCount{0};
+std::atomic<uint32_t> sentCount{0};
+std::atomic<uint32_t> overflowedCount{0};
+std::atomic<uint32_t> droppedCount{0};
 
-// for logging
+// network metrics, updated by every pipeline
 
-FrequencyLogger frequencyLogger = FrequencyLogger("rockets client", 1000);
+NetMetrics netMetrics;
+std::atomic<uint32_t> wifiDropCount{0};
+// only accessed by the upload pipeline
+bool wifiConnected = true;
+
+// mutexes for the buffers
+
+SemaphoreHandle_t clockSyncMutex;
+SemaphoreHandle_t netMetricsMutex;
 
 // private functions
 
-// returns true if successful and queued record is non-empty
-bool getQueuedRecord(Buffer dest) {
-    if (xSemaphoreTake(queuedRecordMutex, portMAX_DELAY)) {
-        strncpy(dest, queuedRecord, sizeof(Buffer));
-        queuedRecord[0] = '\0';
-        xSemaphoreGive(queuedRecordMutex);
-        return strlen(dest) > 0;
+// returns the current absolute timestamp
+int64_t getServerTs() {
+    int64_t now = esp_timer_get_time();
+
+    if (xSemaphoreTake(clockSyncMutex, portMAX_DELAY)) {
+        int64_t ts = clockSync.toServerTime(now);
+        xSemaphoreGive(clockSyncMutex);
+        return ts;
     } else {
-        return false;
+        return now;
+    }
+}
+
+// Runs `update` on the network metrics while holding their mutex.
+void updateMetrics(const std::function<void(NetMetrics& metrics)>& update) {
+    if (xSemaphoreTake(netMetricsMutex, portMAX_DELAY)) {
+        update(netMetrics);
+        xSemaphoreGive(netMetricsMutex);
     }
 }
 
+// Writes a MessagePack string header and string, returns the new position.
+size_t writeMsgPackStr(char* dest, size_t i, const String& str) {
+    size_t len = str.length();
+    if (len < 32) {
+        dest[i++] = 0xa0 | len;  // fixstr
+    } else {
+        dest[i++] = 0xd9;  // str 8
+        dest[i++] = len;
+    }
+    memcpy(dest + i, str.c_str(), len);
+    return i + len;
+}
+
+// Writes the start of a batch body, up to the first record.
+size_t writeBatchHeader(int count) {
+    if (RECORD_ENCODING == RecordEncoding::msgpack) {
+        size_t i = 0;
+        batchBody[i++] = 0x83;  // fixmap with 3 entries
+        i = writeMsgPackStr(batchBody, i, "environmentKey");
+        i = writeMsgPackStr(batchBody, i, ENVIRONMENT_KEY);
+        i = writeMsgPackStr(batchBody, i, "device");
+        i = writeMsgPackStr(batchBody, i, DEVICE);
+        i = writeMsgPackStr(batchBody, i, "records");
+        batchBody[i++] = 0xdc;  // array 16
+        batchBody[i++] = count >> 8;
+        batchBody[i++] = count & 0xff;
+        return i;
+    } else {
+        return snprintf(batchBody, BATCH_BODY_SIZE,
+                        "{\"environmentKey\":\"%s\",\"device\":\"%s\","
+                        "\"records\":[",
+                        ENVIRONMENT_KEY.c_str(), DEVICE.c_str());
+    }
+}
+
+// Writes a /records/batch body containing the oldest queued records that fit
+// into `batchBody`, already serialized in RECORD_ENCODING. Returns the number
+// of records included, which stay queued until the response to the batch
+// request pops them up to `end`.
+int buildBatchBody(uint32_t& end) {
+    // each record with room for a separator, and the closing brackets
+    size_t recordsSize = 2;
+    int count = 0;
+    end = queuedRecords.begin();
+    uint32_t next = end;
+    size_t len;
+    while (queuedRecords.peek(next, len) != NULL &&
+           BATCH_HEADER_SIZE + recordsSize + len + 1 <= BATCH_BODY_SIZE) {
+        recordsSize += len + 1;
+        count++;
+        end = next;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    bool json = RECORD_ENCODING == RecordEncoding::json;
+    size_t i = writeBatchHeader(count);
+
+    uint32_t pos = queuedRecords.begin();
+    for (int r = 0; r < count; r++) {
+        const char* record = queuedRecords.peek(pos, len);
+
+        if (json && r > 0) {
+            batchBody[i++] = ',';
+        }
+        memcpy(batchBody + i, record, len);
+        i += len;
+    }
+
+    if (json) {
+        batchBody[i++] = ']';
+        batchBody[i++] = '}';
+    }
+
+    batchBodyLen = i;
+    return count;
+}
+
 // returns true if successful
-bool setLatestMessage(const Buffer src) {
-    StaticJsonDoc doc;
-    auto err = deserializeJson(doc, src);
+bool setLatestMessage(HttpResponse& res) {
+    StaticJsonDoc& doc = latestMessage.beginWrite();
+    auto err = deserializeJson(doc, res);
 
     if (err != DeserializationError::Ok) {
         Serial.print("Message response deserialization failed: ");
@@ -142,22 +324,17 @@ bool setLatestMessage(const Buffer src) {
         return false;
     }
 
-    // no mutex needed; lastMessageTs is only accessed by this task
+    // no mutex needed; lastMessageTs is only accessed by the messages pipeline
     lastMessageTs = doc["ts"];
 
-    if (xSemaphoreTake(latestMessageMutex, portMAX_DELAY)) {
-        latestMessage = doc;
-        xSemaphoreGive(latestMessageMutex);
-        return true;
-    } else {
-        return false;
-    }
+    latestMessage.commitWrite();
+    return true;
 }
 
 // returns true if successful
-bool setLatestRecords(const Buffer src) {
-    StaticJsonDoc doc;
-    auto err = deserializeJson(doc, src);
+bool setLatestRecords(HttpResponse& res) {
+    StaticJsonDoc& doc = latestRecords.beginWrite();
+    auto err = deserializeJson(doc, res);
 
     if (err != DeserializationError::Ok) {
         Serial.print("Poll records response deserialization failed: ");
@@ -165,319 +342,574 @@ bool setLatestRecords(const Buffer src) {
         return false;
     }
 
-    if (xSemaphoreTake(latestRecordsMutex, portMAX_DELAY)) {
-        latestRecords = doc;
-        xSemaphoreGive(latestRecordsMutex);
-        return true;
-    } else {
-        return false;
-    }
+    latestRecords.commitWrite();
+    return true;
 }
 
 void printHeartbeat() {
-    frequencyLogger.tick();
-
     // Serial.print("Free heap memory (bytes): ");
     // Serial.println(esp_get_free_heap_size());
 
     // Serial.print("Network heartbeat: ");
     if (WiFi.status() == WL_CONNECTED) {
         // Serial.println("WiFi connected");
+        wifiConnected = true;
     } else {
         Serial.println("WiFi not connected");
+        if (wifiConnected) {
+            wifiDropCount++;
+        }
+        wifiConnected = false;
     }
 }
 
-// body is ignored for GET requests
-void postReq(String method, WiFiClient& client, String path, const char* body) {
-    String fullPath = PATH_PREFIX + path;
+// Body is ignored for GET requests. Returns the number of bytes written. The
+// head is written in one go, since with Nagle disabled every write is a packet.
+size_t postReq(String method, WiFiClient& client, String path,
+               const char* body, size_t bodyLen) {
+    String head = method + " " + PATH_PREFIX + path + " HTTP/1.1\r\n";
+
+    head += "Host: " + HOST + "\r\n";
+    head += KEEP_ALIVE ? "Connection: keep-alive\r\n"
+                       : "Connection: close\r\n";
+
+    if (method != "GET") {
+        head += RECORD_ENCODING == RecordEncoding::msgpack
+                    ? "Content-Type: application/msgpack\r\n"
+                    : "Content-Type: application/json\r\n";
+        head += "Content-Length: " + String(bodyLen) + "\r\n";
+    }
+    head += "\r\n";
 
     client.setTimeout(3);
 
-    client.print(method);
-    client.print(" ");
-    client.print(fullPath);
-    client.println(" HTTP/1.1");
+    size_t n = client.print(head);
+    if (method != "GET") {
+        n += client.write((const uint8_t*)body, bodyLen);
+    }
+    return n;
+}
 
-    client.print("Host: ");
-    client.println(HOST);
+// Prints the status and the start of the body of a failed response.
+void printFailedRes(const char* label, HttpResponse& res) {
+    char body[128];
+    res.readBody(body, sizeof(body));
 
-    client.println("Connection: close");
+    Serial.print(label);
+    Serial.print(" failed, status: ");
+    Serial.println(res.getStatus());
+    Serial.println(body);
+}
 
-    if (method == "GET") {
-        client.println();
-    } else {
-        client.println("Content-Type: application/json");
+// Called once the status line and headers of the response to a request have
+// been read. The body is consumed straight off the socket.
+typedef std::function<void(HttpResponse& res)> ResHandler;
+
+struct Req {
+    const char* method;
+    String path;
+    Endpoint endpoint;  // for metrics
+    const char* body;  // ignored for GET requests
+    size_t bodyLen;
+    ResHandler onRes;
+
+    // filled in by sendReq
+    int64_t sentTs;  // esp_timer_get_time() when the request was written
+    int status;      // 0 if no response was received
+};
+
+// A pipeline's connection to the server.
+struct Connection {
+    WiFiClient client;
+    unsigned long timeoutMs;  // for each response
+};
+
+// A loop run in its own task, so that a slow or failing endpoint can't hold
+// up the others.
+struct Pipeline {
+    const char* name;
+    unsigned long timeoutMs;
+    unsigned long intervalMs;  // min time between the starts of two ticks
+    void (*tick)(Connection& conn);
+    // optional; sets up the connection before the first tick
+    void (*initConnection)(Connection& conn);
+};
+
+// Returns true if the client is connected, reusing the existing connection
+// in keep-alive mode. Sets `reused` to true if no new connection was opened.
+// The time taken to connect is recorded for `endpoint`.
+bool connect(WiFiClient& client, bool& reused, Endpoint endpoint) {
+    reused = KEEP_ALIVE && client.connected();
+    if (reused) {
+        return true;
+    }
+
+    client.stop();
+
+    int64_t start = esp_timer_get_time();
+    bool connected = client.connect(HOST.c_str(), PORT);
+    int64_t elapsed = esp_timer_get_time() - start;
 
-        client.print("Content-Length: ");
-        client.println(strlen(body));
+    if (connected) {
+        // otherwise a request written in more than one piece waits for the
+        // ack of the first, which the server delays, on reused connections
+        client.setNoDelay(true);
 
-        client.println();
-        client.print(body);
+        updateMetrics([&](NetMetrics& metrics) {
+            metrics[endpoint].connect.add(elapsed);
+        });
     }
+    return connected;
 }
 
-// returns true if successful
-bool readRes(WiFiClient& client, Buffer dest) {
-    int TIMEOUT = 3000;
+enum class ReqResult {
+    connectFailed,
+    noResponse,  // not a single byte came back
+    incomplete,  // e.g. a timeout partway through the response
+    completed,
+};
 
-    int i = 0;
-    int startTime = millis();
+// Writes the request, then reads the response and passes it to the request's
+// handler. Sets `reused` to true if an existing connection was used.
+ReqResult trySendReq(Connection& conn, Req& req, bool& reused) {
+    WiFiClient& client = conn.client;
+    req.status = 0;
 
-    while (client.connected()) {
-        if (millis() - startTime > TIMEOUT) {
-            return false;
-        }
+    if (!connect(client, reused, req.endpoint)) {
+        return ReqResult::connectFailed;
+    }
 
-        while (client.available()) {
-            if (millis() - startTime > TIMEOUT) {
-                return false;
-            }
+    req.sentTs = esp_timer_get_time();
+    size_t sent = postReq(req.method, client, req.path, req.body, req.bodyLen);
+    updateMetrics([&](NetMetrics& metrics) {
+        metrics[req.endpoint].bytesSent += sent;
+    });
+
+    HttpResponse res(client, conn.timeoutMs);
+    if (!res.readHead()) {
+        client.stop();
+        return res.gotAnyBytes() ? ReqResult::incomplete
+                                 : ReqResult::noResponse;
+    }
 
-            char c = client.read();
-            if (i < sizeof(Buffer) - 1) {
-                dest[i] = c;
-                i++;
-            }
+    req.status = res.getStatus();
+    req.onRes(res);
+
+    // the rest of the body must be drained before the next response
+    bool finished = res.finish();
+
+    int64_t endTs = esp_timer_get_time();
+    updateMetrics([&](NetMetrics& metrics) {
+        EndpointStats& stats = metrics[req.endpoint];
+        stats.bytesReceived += res.getBytesRead();
+        stats.firstByte.add(res.getFirstByteTs() - req.sentTs);
+        // a body cut off by a timeout is counted as a timeout by sendReq
+        if (finished) {
+            metrics.addStatus(req.endpoint, req.status);
+            stats.total.add(endTs - req.sentTs);
         }
+    });
 
-        yield();
+    if (!finished || !KEEP_ALIVE || !res.canReuseConnection()) {
+        client.stop();
     }
-
-    dest[i] = '\0';
-    return true;
+    return finished ? ReqResult::completed : ReqResult::incomplete;
 }
 
-// returns HTTP status, or 0 if error
-int parseResBody(const Buffer res, Buffer dest) {
-    int status;
-
-    bool readStatus = sscanf(res, "HTTP/1.1 %d", &status);
-    if (!readStatus) {
-        return 0;
+// Returns true if the response was received in full. A reused connection may
+// have been closed by the server while idle, so if it yields nothing at all
+// we retry once on a fresh connection.
+bool sendReq(Connection& conn, Req& req) {
+    // once per request, however many times it is tried
+    updateMetrics(
+        [&](NetMetrics& metrics) { metrics[req.endpoint].requests++; });
+
+    bool reused;
+    ReqResult result = trySendReq(conn, req, reused);
+
+    if (result == ReqResult::noResponse && reused) {
+        updateMetrics([&](NetMetrics& metrics) {
+            metrics[req.endpoint].staleRetries++;
+        });
+        result = trySendReq(conn, req, reused);
     }
 
-    // read until empty line (end of headers)
-    const char* lineStart = res;
-    while (true) {
-        const char* lineEnd = strstr(lineStart, "\r\n");
-        if (lineEnd == NULL) {
-            return 0;
-        }
-        if (lineEnd == lineStart) {
-            lineStart += 2;
+    switch (result) {
+        case ReqResult::completed:
+            return true;
+        case ReqResult::connectFailed:
+            updateMetrics([&](NetMetrics& metrics) {
+                metrics[req.endpoint].connectFailures++;
+            });
+            Serial.println("Connect failed");
+            return false;
+        case ReqResult::noResponse:
+        case ReqResult::incomplete:
             break;
-        }
-        lineStart = lineEnd + 2;
     }
-
-    strncpy(dest, lineStart, sizeof(Buffer));
-    return status;
+    updateMetrics(
+        [&](NetMetrics& metrics) { metrics[req.endpoint].timeouts++; });
+    Serial.println("Network timeout");
+    return false;
 }
 
-// Returns true if successful.
-bool trySyncTs(WiFiClient& client) {
+// Takes one clock sample. Returns true if successful.
+bool trySampleTs(Connection& conn) {
+    int64_t serverTs = 0;
+    int64_t receivedTs = 0;
     bool success = false;
 
-    String path = "/ts";
-
-    if (client.connect(HOST.c_str(), PORT)) {
-        Serial.println("Syncing ts");
-
-        postReq("GET", client, path, NULL);
+    Req req = {
+        .method = "GET",
+        .path = "/ts",
+        .endpoint = Endpoint::ts,
+        .body = NULL,
+        .bodyLen = 0,
+        .onRes =
+            [&](HttpResponse& res) {
+                // the server's clock was read before it sent the headers
+                receivedTs = esp_timer_get_time();
+
+                if (res.getStatus() != 200) {
+                    printFailedRes("syncTs", res);
+                    return;
+                }
 
-        Buffer res;
-        if (readRes(client, res)) {
-            Buffer resBody;
-            int status = parseResBody(res, resBody);
+                char body[32];
+                res.readBody(body, sizeof(body));
+                serverTs = strtoll(body, NULL, 10);
 
-            if (status == 200) {
-                Serial.println("syncTs success");
-                int64_t syncedTs = strtoll(resBody, NULL, 10);
+                success = true;
+            },
+        .sentTs = 0,
+        .status = 0,
+    };
 
-                absoluteTsOffset = syncedTs - esp_timer_get_time();
-                lastMessageTs = syncedTs;
+    if (!sendReq(conn, req)) {
+        Serial.println("syncTs failed");
+        return false;
+    }
 
-                success = true;
-            } else {
-                Serial.print("syncTs failed, status: ");
-                Serial.println(status);
-                Serial.println(resBody);
-            }
-        } else {
-            Serial.println("syncTs failed, network timeout");
-        }
-    } else {
-        Serial.println("syncTs connect failed");
+    if (success && xSemaphoreTake(clockSyncMutex, portMAX_DELAY)) {
+        clockSync.addSample(req.sentTs, receivedTs, serverTs);
+        xSemaphoreGive(clockSyncMutex);
     }
 
-    client.stop();
     return success;
 }
 
-void syncTs(WiFiClient& client) {
-    while (true) {
-        int64_t start = esp_timer_get_time();
-        bool success = trySyncTs(client);
-        int64_t end = esp_timer_get_time();
+// Applies the best sample of the current round to the clock estimate.
+// Returns false if the round has no samples.
+bool applyTsSamples(bool step) {
+    int64_t bestRtt = 0;
+    bool applied = false;
 
-        delay(5);
+    if (xSemaphoreTake(clockSyncMutex, portMAX_DELAY)) {
+        bestRtt = clockSync.getBestRtt();
+        applied = clockSync.apply(esp_timer_get_time(), step);
+        xSemaphoreGive(clockSyncMutex);
+    }
 
-        if (!success) {
-            Serial.println("trySyncTs failed, retrying...");
-            continue;
-        }
+    lastTsSyncMillis = millis();
+    if (!applied) {
+        return false;
+    }
+    tsSynced = true;
 
-        int64_t elapsed_ms = (end - start) / 1000;
+    Serial.print("syncTs best round trip (ms): ");
+    Serial.println(bestRtt / 1000);
 
-        Serial.print("trySyncTs took (ms): ");
-        Serial.println(elapsed_ms);
+    if (bestRtt / 1000 > MAX_TS_DELAY_MS) {
+        Serial.println("syncTs round trip is high, timestamps may be off");
+    }
+    return true;
+}
 
-        if (elapsed_ms > MAX_TS_DELAY_MS) {
-            Serial.println("trySyncTs took too long, retrying...");
-            continue;
+// Blocks until the clock is synced for the first time, so that records aren't
+// queued with local timestamps, but gives up after
+// TS_INITIAL_SYNC_MAX_ATTEMPTS tries or TS_INITIAL_SYNC_TIMEOUT_MS, so an
+// unreachable server can't hold up uploads forever. tickTsSync() keeps trying
+// after that.
+void syncTs(Connection& conn) {
+    Serial.println("Syncing ts");
+
+    unsigned long start = millis();
+    int samples = 0;
+    for (int attempt = 0; attempt < TS_INITIAL_SYNC_MAX_ATTEMPTS &&
+                          samples < TS_SYNC_SAMPLE_COUNT &&
+                          millis() - start < TS_INITIAL_SYNC_TIMEOUT_MS;
+         attempt++) {
+        if (trySampleTs(conn)) {
+            samples++;
+        } else {
+            Serial.println("trySampleTs failed, retrying...");
         }
+        delay(5);
+    }
 
-        break;
+    if (!applyTsSamples(true)) {
+        Serial.println("syncTs gave up, timestamps are local until it syncs");
     }
 }
 
-void sendQueuedRecord(WiFiClient& client) {
-    Buffer record;
-    if (!getQueuedRecord(record)) {
+// Takes at most one clock sample per upload tick, so that resyncing never
+// holds up uploads for more than a round trip.
+void tickTsSync(Connection& conn) {
+    bool roundInProgress = tsSamplesTaken > 0 || syncTsRequested ||
+                           !tsSynced ||
+                           millis() - lastTsSyncMillis > TS_RESYNC_INTERVAL_MS;
+    if (!roundInProgress) {
         return;
     }
 
-    if (client.connect(HOST.c_str(), PORT)) {
-        // Serial.println("Sending queued record");
-
-        postReq("POST", client, "/records", record);
+    if (trySampleTs(conn)) {
+        tsSamplesTaken++;
+    }
 
-        Buffer res;
-        if (readRes(client, res)) {
-            Buffer resBody;
-            int status = parseResBody(res, resBody);
+    if (tsSamplesTaken >= TS_SYNC_SAMPLE_COUNT) {
+        // an explicit sync should take effect right away
+        applyTsSamples(syncTsRequested.exchange(false));
+        tsSamplesTaken = 0;
+    }
+}
 
-            if (status == 200) {
-                // Serial.println("sendQueuedRecord success");
-            } else {
-                Serial.print("sendQueuedRecord failed, status: ");
-                Serial.println(status);
-                Serial.println(resBody);
-            }
-        } else {
-            Serial.println("sendQueuedRecord failed, network timeout");
-        }
-    } else {
-        Serial.println("sendQueuedRecord connect failed");
+// set after a 5xx; only accessed by the upload pipeline
+unsigned long uploadRetryMillis = 0;
+bool uploadRetryPending = false;
+
+// Fills `req` with a request uploading the oldest queued records. Returns
+// false if there are none. Records are only popped once the server has
+// accepted them (2xx) or rejected them (4xx); on a 5xx, or if the request
+// never gets a response, they stay queued and go out with the next batch.
+bool makeRecordsBatchReq(Req& req) {
+    uint32_t end;
+    int count = buildBatchBody(end);
+    if (count == 0) {
+        return false;
     }
 
-    client.stop();
+    req = {
+        .method = "POST",
+        .path = "/records/batch",
+        .endpoint = Endpoint::recordsBatch,
+        .body = batchBody,
+        .bodyLen = batchBodyLen,
+        .onRes =
+            [count, end](HttpResponse& res) {
+                int status = res.getStatus();
+
+                if (status >= 200 && status < 300) {
+                    // Serial.println("sendQueuedRecords success");
+                    queuedRecords.popTo(end);
+                    sentCount += count;
+                } else if (status >= 500 && status < 600) {
+                    // the server may recover; retry the same records
+                    printFailedRes("sendQueuedRecords", res);
+                    uploadRetryMillis = millis() + UPLOAD_RETRY_DELAY_MS;
+                    uploadRetryPending = true;
+                } else {
+                    // resending won't help
+                    printFailedRes("sendQueuedRecords", res);
+                    queuedRecords.popTo(end);
+                    droppedCount += count;
+                }
+            },
+        .sentTs = 0,
+        .status = 0,
+    };
+    return true;
 }
 
-void pollLatestMessage(WiFiClient& client) {
+Req makeMessageReq() {
     String path = "/messages/next?environmentKey=" + ENVIRONMENT_KEY +
                   "&device=" + DEVICE + "&afterTs=" + lastMessageTs;
+    if (MESSAGE_WAIT_MS > 0) {
+        path += "&waitMs=" + String(MESSAGE_WAIT_MS);
+    }
 
-    if (client.connect(HOST.c_str(), PORT)) {
-        // Serial.println("Polling latest message");
+    return {
+        .method = "GET",
+        .path = path,
+        .endpoint = Endpoint::messagesNext,
+        .body = NULL,
+        .bodyLen = 0,
+        .onRes =
+            [](HttpResponse& res) {
+                if (res.getStatus() != 200) {
+                    printFailedRes("pollLatestMessage", res);
+                    return;
+                }
 
-        postReq("GET", client, path, NULL);
+                // Serial.println("pollLatestMessage success");
 
-        Buffer res;
-        if (readRes(client, res)) {
-            Buffer resBody;
-            int status = parseResBody(res, resBody);
+                // the body is "NONE" if there is no new message
+                if (res.peek() != 'N') {
+                    setLatestMessage(res);
+                }
+            },
+        .sentTs = 0,
+        .status = 0,
+    };
+}
 
-            if (status == 200) {
-                // Serial.println("pollLatestMessage success");
+void initMessagesConnection(Connection& conn) {
+    // a long poll legitimately takes up to the wait before responding
+    conn.timeoutMs += MESSAGE_WAIT_MS;
+}
 
-                if (strcmp(resBody, "NONE") != 0) {
-                    setLatestMessage(resBody);
+Req makeRecordsReq() {
+    return {
+        .method = "GET",
+        .path = "/records/multiDevice?environmentKey=" + ENVIRONMENT_KEY +
+                "&devices=" + POLL_RECORD_DEVICES,
+        .endpoint = Endpoint::recordsMultiDevice,
+        .body = NULL,
+        .bodyLen = 0,
+        .onRes =
+            [](HttpResponse& res) {
+                if (res.getStatus() != 200) {
+                    printFailedRes("pollLatestRecords", res);
+                    return;
                 }
-            } else {
-                Serial.print("pollLatestMessage failed, status: ");
-                Serial.println(status);
-                Serial.println(resBody);
-            }
-        } else {
-            Serial.println("pollLatestMessage failed, network timeout");
-        }
-    } else {
-        Serial.println("pollLatestMessage connect failed");
+
+                // Serial.println("pollLatestRecords success");
+
+                setLatestRecords(res);
+            },
+        .sentTs = 0,
+        .status = 0,
+    };
+}
+
+void sendQueuedRecords(Connection& conn) {
+    if (uploadRetryPending && (long)(millis() - uploadRetryMillis) < 0) {
+        return;
     }
+    uploadRetryPending = false;
 
-    client.stop();
+    Req req;
+    if (!makeRecordsBatchReq(req)) {
+        return;
+    }
+
+    if (!sendReq(conn, req)) {
+        Serial.println("sendQueuedRecords failed");
+    }
+}
+
+void pollLatestMessage(Connection& conn) {
+    Req req = makeMessageReq();
+    if (!sendReq(conn, req)) {
+        Serial.println("pollLatestMessage failed");
+    }
 }
 
-void pollLatestRecords(WiFiClient& client) {
-    String path = "/records/multiDevice?environmentKey=" + ENVIRONMENT_KEY +
-                  "&devices=" + POLL_RECORD_DEVICES;
+void pollLatestRecords(Connection& conn) {
+    Req req = makeRecordsReq();
+    if (!sendReq(conn, req)) {
+        Serial.println("pollLatestRecords failed");
+    }
+}
 
-    if (client.connect(HOST.c_str(), PORT)) {
-        // Serial.println("Polling latest records");
+// pipelines
 
-        postReq("GET", client, path, NULL);
+void tickUpload(Connection& conn) {
+    printHeartbeat();
 
-        Buffer res;
-        if (readRes(client, res)) {
-            Buffer resBody;
-            int status = parseResBody(res, resBody);
+    if (!initialTsSyncTried) {
+        syncTs(conn);
+        initialTsSyncTried = true;
+    }
 
-            if (status == 200) {
-                // Serial.println("pollLatestRecords success");
+    tickTsSync(conn);
+    sendQueuedRecords(conn);
+}
 
-                setLatestRecords(resBody);
-            } else {
-                Serial.print("pollLatestRecords failed, status: ");
-                Serial.println(status);
-                Serial.println(resBody);
-            }
-        } else {
-            Serial.println("pollLatestRecords failed, network timeout");
-        }
-    } else {
-        Serial.println("pollLatestRecords connect failed");
+void tickMessages(Connection& conn) {
+    if (!tsSynced) {
+        return;
     }
 
-    client.stop();
+    if (lastMessageTs == 0) {
+        // only fetch messages sent from now on
+        lastMessageTs = getServerTs();
+    }
+
+    pollLatestMessage(conn);
 }
 
-void runTask(void* pvParameters) {
-    WiFiClient client;
+void tickRecords(Connection& conn) { pollLatestRecords(conn); }
 
-    syncTs(client);
+const Pipeline UPLOAD_PIPELINE = {
+    .name = "upload",
+    .timeoutMs = UPLOAD_TIMEOUT_MS,
+    .intervalMs = UPLOAD_INTERVAL_MS,
+    .tick = tickUpload,
+    .initConnection = NULL,
+};
 
-    while (true) {
-        printHeartbeat();
+const Pipeline MESSAGES_PIPELINE = {
+    .name = "messages",
+    .timeoutMs = MESSAGES_TIMEOUT_MS,
+    .intervalMs = MESSAGES_INTERVAL_MS,
+    .tick = tickMessages,
+    .initConnection = initMessagesConnection,
+};
 
-        if (syncTsRequested) {
-            syncTs(client);
-            syncTsRequested = false;
-        }
+const Pipeline RECORDS_PIPELINE = {
+    .name = "records",
+    .timeoutMs = RECORDS_TIMEOUT_MS,
+    .intervalMs = RECORDS_INTERVAL_MS,
+    .tick = tickRecords,
+    .initConnection = NULL,
+};
 
-        sendQueuedRecord(client);
-        delay(5);
+void runPipelineTask(void* pvParameters) {
+    const Pipeline& pipeline = *(const Pipeline*)pvParameters;
 
-        if (POLL_MESSAGES) {
-            pollLatestMessage(client);
-            delay(5);
-        }
+    Connection conn;
+    conn.timeoutMs = pipeline.timeoutMs;
+    if (pipeline.initConnection != NULL) {
+        pipeline.initConnection(conn);
+    }
 
-        if (POLL_RECORD_DEVICES.length() > 0) {
-            pollLatestRecords(client);
-            delay(5);
-        }
+    FrequencyLogger frequencyLogger(
+        String("rockets client ") + pipeline.name, 1000);
+
+    while (true) {
+        unsigned long start = millis();
+
+        frequencyLogger.tick();
+        pipeline.tick(conn);
+
+        // rate limit, but always yield to lower priority tasks
+        unsigned long elapsed = millis() - start;
+        delay(elapsed < pipeline.intervalMs ? pipeline.intervalMs - elapsed
+                                            : 1);
     }
 }
 
+void startPipeline(const Pipeline& pipeline) {
+    String taskName = String("network ") + pipeline.name;
+    xTaskCreatePinnedToCore(runPipelineTask, taskName.c_str(), STACK_DEPTH,
+                            (void*)&pipeline, PRIORITY, NULL, CORE_ID);
+}
+
 void initTask() {
-    queuedRecordMutex = xSemaphoreCreateMutex();
-    latestMessageMutex = xSemaphoreCreateMutex();
-    latestRecordsMutex = xSemaphoreCreateMutex();
+    latestMessage.init();
+    latestRecords.init();
+    clockSyncMutex = xSemaphoreCreateMutex();
+    netMetricsMutex = xSemaphoreCreateMutex();
+
+    startPipeline(UPLOAD_PIPELINE);
+
+    if (POLL_MESSAGES) {
+        startPipeline(MESSAGES_PIPELINE);
+    }
 
-    xTaskCreatePinnedToCore(runTask, "network", STACK_DEPTH, NULL, PRIORITY,
-                            NULL, CORE_ID);
+    if (POLL_RECORD_DEVICES.length() > 0) {
+        startPipeline(RECORDS_PIPELINE);
+    }
 }
 
 void initWifi() {
@@ -499,54 +931,197 @@ void initWifi() {
     Serial.println(WiFi.localIP());
 }
 
+void printStat(const char* label, uint32_t value) {
+    Serial.print("  ");
+    Serial.print(label);
+    Serial.print(": ");
+    Serial.println(value);
+}
+
+void printHistogram(const char* label, const LatencyHistogram& histogram) {
+    Serial.print("  ");
+    Serial.print(label);
+    Serial.print(" p50/p99/max (ms): ");
+    Serial.print(histogram.percentileMs(0.5));
+    Serial.print("/");
+    Serial.print(histogram.percentileMs(0.99));
+    Serial.print("/");
+    Serial.println(histogram.maxMs());
+}
+
+// Adds a compact summary of the network metrics to `net`; see
+// setAttachNetworkStats().
+void addNetworkStats(JsonObject net) {
+    for (int i = 0; i < ENDPOINT_COUNT; i++) {
+        Endpoint endpoint = (Endpoint)i;
+        EndpointStats stats = getEndpointStats(endpoint);
+        if (stats.requests == 0) {
+            continue;
+        }
+
+        JsonArray summary =
+            net.createNestedArray(NetMetrics::endpointPath(endpoint));
+        summary.add(stats.requests);
+        summary.add(stats.status2xx);
+        summary.add(stats.timeouts);
+        summary.add(stats.connectFailures);
+        summary.add(stats.total.percentileMs(0.5));
+        summary.add(stats.total.percentileMs(0.99));
+    }
+
+    net["wifiDrops"] = getWifiDropCount();
+}
+
+// Allocates the record queue and the batch body the first time a record is
+// queued, so clients that only poll don't reserve them. The upload pipeline
+// doesn't touch either until a record has been committed to the queue.
+bool allocateRecordBuffers() {
+    if (batchBody == NULL) {
+        batchBody = (char*)malloc(BATCH_BODY_SIZE);
+    }
+    if (batchBody == NULL || !queuedRecords.allocate()) {
+        static bool printed = false;
+        if (!printed) {
+            Serial.println("Not enough memory to queue records");
+            printed = true;
+        }
+        return false;
+    }
+    return true;
+}
+
 // implementation of the interface
 
 void syncTimestamp() { syncTsRequested = true; }
 
+bool isTimestampSynced() { return tsSynced; }
+
 bool queueRecord(const StaticJsonDoc& recordData) {
+    if (!allocateRecordBuffers()) {
+        droppedCount++;
+        return false;
+    }
+
     StaticJsonDoc record;
 
-    record["environmentKey"] = ENVIRONMENT_KEY;
-    record["device"] = DEVICE;
-    record["ts"] = esp_timer_get_time() + absoluteTsOffset;
+    record["ts"] = getServerTs();
 
     JsonObject data = record.createNestedObject("data");
     data.set(recordData.as<JsonObjectConst>());
 
-    if (xSemaphoreTake(queuedRecordMutex, portMAX_DELAY)) {
-        serializeJson(record, queuedRecord, sizeof(Buffer));
-        xSemaphoreGive(queuedRecordMutex);
-        return true;
-    } else {
+    bool withNetStats =
+        attachNetworkStats &&
+        millis() - lastNetStatsAttachMillis >= NET_STATS_ATTACH_INTERVAL_MS;
+    if (withNetStats) {
+        addNetworkStats(data.createNestedObject("net"));
+    }
+
+    bool msgpack = RECORD_ENCODING == RecordEncoding::msgpack;
+
+    size_t size = msgpack ? measureMsgPack(record) : measureJson(record);
+    if (size >= RECORD_SIZE && withNetStats) {
+        // the stats are optional; try again with the next record
+        data.remove("net");
+        withNetStats = false;
+        size = msgpack ? measureMsgPack(record) : measureJson(record);
+    }
+    if (size >= RECORD_SIZE) {
+        Serial.print("Record too large to queue, dropped it: ");
+        Serial.print(size);
+        Serial.print(" bytes, max ");
+        Serial.println(RECORD_SIZE - 1);
+        droppedCount++;
         return false;
     }
+
+    char* slot = queuedRecords.beginPush(size);
+    if (slot == NULL) {
+        overflowedCount++;
+        return false;
+    }
+
+    size_t len = msgpack ? serializeMsgPack(record, slot, size + 1)
+                         : serializeJson(record, slot, size + 1);
+    queuedRecords.commitPush(len);
+    queuedCount++;
+
+    if (withNetStats) {
+        lastNetStatsAttachMillis = millis();
+    }
+    return true;
+}
+
+RecordStats getRecordStats() {
+    RecordStats stats = {
+        .queued = queuedCount,
+        .sent = sentCount,
+        .overflowed = overflowedCount,
+        .dropped = droppedCount,
+    };
+    return stats;
+}
+
+EndpointStats getEndpointStats(Endpoint endpoint) {
+    EndpointStats stats = {};
+    updateMetrics([&](NetMetrics& metrics) { stats = metrics[endpoint]; });
+    return stats;
+}
+
+uint32_t getWifiDropCount() { return wifiDropCount; }
+
+void printNetworkStats() {
+    for (int i = 0; i < ENDPOINT_COUNT; i++) {
+        Endpoint endpoint = (Endpoint)i;
+        EndpointStats stats = getEndpointStats(endpoint);
+        if (stats.requests == 0) {
+            continue;
+        }
+
+        Serial.println(NetMetrics::endpointPath(endpoint));
+        printStat("requests", stats.requests);
+        printStat("stale retries", stats.staleRetries);
+        printStat("connect failures", stats.connectFailures);
+        printStat("timeouts", stats.timeouts);
+        printStat("2xx", stats.status2xx);
+        printStat("4xx", stats.status4xx);
+        printStat("5xx", stats.status5xx);
+        printStat("other status", stats.statusOther);
+        printStat("bytes sent", stats.bytesSent);
+        printStat("bytes received", stats.bytesReceived);
+        printHistogram("connect", stats.connect);
+        printHistogram("first byte", stats.firstByte);
+        printHistogram("total", stats.total);
+    }
+
+    printStat("WiFi drops", getWifiDropCount());
+}
+
+void setAttachNetworkStats(bool attach) { attachNetworkStats = attach; }
+
+bool borrowLatestMessage(const DocCallback& callback) {
+    return latestMessage.readIfNewer(lastReadMessageVersion, callback);
 }
 
 StaticJsonDoc getLatestMessage() {
     StaticJsonDoc doc;
+    borrowLatestMessage([&](const StaticJsonDoc& message) { doc = message; });
+    return doc;
+}
 
-    if (xSemaphoreTake(latestMessageMutex, portMAX_DELAY)) {
-        doc = latestMessage;
-        latestMessage = StaticJsonDoc();
-        xSemaphoreGive(latestMessageMutex);
-        return doc;
-    } else {
-        // return empty json object
-        return doc;
-    }
+bool borrowLatestRecords(uint32_t& version, const DocCallback& callback) {
+    return latestRecords.readIfNewer(version, callback);
+}
+
+bool tryGetLatestRecords(StaticJsonDoc& dest, uint32_t& version) {
+    return borrowLatestRecords(
+        version, [&](const StaticJsonDoc& records) { dest = records; });
 }
 
 StaticJsonDoc getLatestRecords() {
     StaticJsonDoc doc;
-
-    if (xSemaphoreTake(latestRecordsMutex, portMAX_DELAY)) {
-        doc = latestRecords;
-        xSemaphoreGive(latestRecordsMutex);
-        return doc;
-    } else {
-        // return empty json object
-        return doc;
-    }
+    uint32_t version = 0;
+    tryGetLatestRecords(doc, version);
+    return doc;
 }
 
 // `pollRecordDevices` should be a comma-separated list of devices, e.g.
@@ -560,6 +1135,9 @@ void init(WifiConfig wifiConfig, ServerConfig serverConfig,
     HOST = serverConfig.host;
     PORT = serverConfig.port;
     PATH_PREFIX = serverConfig.pathPrefix;
+    KEEP_ALIVE = serverConfig.keepAlive;
+    RECORD_ENCODING = serverConfig.recordEncoding;
+    MESSAGE_WAIT_MS = serverConfig.messageWaitMs;
 
     ENVIRONMENT_KEY = environmentKey;
     DEVICE = device;
@@ -6,12 +6,32 @@
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include <functional>
+
+#include "net_metrics.h"
+
 namespace rockets_client {
 
+enum class RecordEncoding {
+    json,     // application/json
+    msgpack,  // application/msgpack; smaller, and cheaper to serialize
+};
+
 struct ServerConfig {
     String host;
     int port;
     String pathPrefix;
+    // If true, each network task reuses one HTTP/1.1 connection for all of
+    // its requests. The connection is transparently reopened if the server
+    // closes it.
+    bool keepAlive;
+    // Encoding of uploaded records.
+    RecordEncoding recordEncoding;
+    // If nonzero, message polls ask the server to hold the request open for up
+    // to this long and respond as soon as a message arrives (long polling),
+    // instead of responding "NONE" right away. Servers that don't support it
+    // just respond right away.
+    unsigned long messageWaitMs;
 };
 
 struct WifiConfig {
@@ -37,25 +57,80 @@ struct ServerConfigPresets {
 extern ServerConfigPresets serverConfigPresets;
 
 typedef StaticJsonDocument<1024> StaticJsonDoc;
-typedef char Buffer[2048];  // give it some extra space
 
-// Sets a flag that will cause the timestamp to be updated on the next loop.
+// Receives a borrowed document, which is only valid during the call. The
+// network task can't publish a new one until the callback returns, so keep it
+// short.
+typedef std::function<void(const StaticJsonDoc& doc)> DocCallback;
+
+struct RecordStats {
+    uint32_t queued;      // accepted by queueRecord
+    uint32_t sent;        // acknowledged by the server
+    uint32_t overflowed;  // rejected by queueRecord because the queue was full
+    // too large to queue, no memory for the queue, or rejected by the server
+    uint32_t dropped;
+};
+
+// Starts a timestamp sync in the background. Unlike the periodic resyncs,
+// whose corrections are slewed in gradually, its result is applied at once.
 void syncTimestamp();
 
+// False until the first timestamp sync succeeds. If the server can't be
+// reached at boot, uploads start anyway, and records carry local timestamps
+// (esp_timer_get_time()) until then.
+bool isTimestampSynced();
+
 // Returns true if the record was successfully queued. Creates a record with
-// appropriate `environmentKey`, `device`, and `ts` fields, and sets the `data`
-// field to `recordData`.
+// the appropriate `ts` field, and sets the `data` field to `recordData`.
+// Records are buffered in a fixed-size queue and uploaded in batches (tagged
+// with `environmentKey` and `device`), so no record is lost unless the queue
+// fills up faster than the network can drain it. The queue (about 32 kB with
+// the batch body) is allocated by the first call.
 bool queueRecord(const StaticJsonDoc& recordData);
 
-// Returns an empty json object ("{}") if there is no message since the last
-// call. Must set `pollMessages` to true during init.
+// Counters for records passed to queueRecord since init.
+RecordStats getRecordStats();
+
+// Request metrics for `endpoint` since init, for telling whether failures
+// come from the network (connect failures, timeouts) or the server (error
+// statuses).
+EndpointStats getEndpointStats(Endpoint endpoint);
+
+// Number of times Wi-Fi was found disconnected since init.
+uint32_t getWifiDropCount();
+
+// Prints a summary of getEndpointStats() for every endpoint used so far.
+void printNetworkStats();
+
+// If true, queueRecord adds a summary of the network metrics to the data of
+// at most one record per second, under "net". Each endpoint used so far gets
+// an array of [requests, 2xx responses, timeouts, connect failures, p50 ms,
+// p99 ms], keyed by its path; "wifiDrops" holds getWifiDropCount(). Off by
+// default.
+void setAttachNetworkStats(bool attach);
+
+// Calls `callback` with the latest message and returns true if there is a
+// message since the last call to this or getLatestMessage(). The message is
+// not copied. Must set `pollMessages` to true during init.
+bool borrowLatestMessage(const DocCallback& callback);
+
+// Like borrowLatestMessage(), but returns a copy. Returns an empty json object
+// ("{}") if there is no message since the last call.
 StaticJsonDoc getLatestMessage();
 
-// Returns an empty object if unsuccessful or the first poll is still in
-// progress. If the object is not empty, then there will be a key for each
-// requested device, with a record object or null as the value. This does not
-// erase the stored records after retrieving them. Must set `pollRecordsDevices`
-// to a non-empty string during init.
+// If the polled records have changed since `version`, calls `callback` with
+// them, updates `version` and returns true; otherwise does nothing. Start with
+// a version of 0. There will be a key for each requested device, with a
+// record object or null as the value. The records are not copied. Must set
+// `pollRecordsDevices` to a non-empty string during init.
+bool borrowLatestRecords(uint32_t& version, const DocCallback& callback);
+
+// Like borrowLatestRecords(), but copies the records into `dest`.
+bool tryGetLatestRecords(StaticJsonDoc& dest, uint32_t& version);
+
+// Returns a copy of the latest records. Returns an empty object if the first
+// poll is still in progress. This does not erase the stored records after
+// retrieving them. Prefer tryGetLatestRecords() when polling in a loop.
 StaticJsonDoc getLatestRecords();
 
 void init(WifiConfig wifiConfig, ServerConfig serverConfig,
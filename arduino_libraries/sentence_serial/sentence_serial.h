@@ -3,17 +3,46 @@
 
 #include <Arduino.h>
 
+// Sends and receives <sentences> of up to MaxLen characters. Received
+// sentences are assembled in a fixed buffer, so nothing is allocated.
+template <size_t MaxLen = 64>
 class SentenceSerial {
    private:
-    static const int MAX_SENTENCE_LEN = 64;
     static const char SENTENCE_START = '<';
     static const char SENTENCE_END = '>';
+    static const size_t READ_CHUNK_SIZE = 64;
 
     HardwareSerial &serial;
     std::function<void(const char *)> processCompletedSentence;
 
-    String curSentence;
+    char curSentence[MaxLen + 1];  // +1 for null terminator
+    size_t curLen = 0;
     bool sawStart = false;
+    uint32_t overflowCount = 0;
+
+    void processChar(char c) {
+        if (c == SENTENCE_START) {
+            curLen = 0;
+            sawStart = true;
+        } else if (c == SENTENCE_END) {
+            if (sawStart) {
+                curSentence[curLen] = '\0';
+                processCompletedSentence(curSentence);
+            }
+            sawStart = false;
+        } else if (sawStart) {
+            if (curLen < MaxLen) {
+                curSentence[curLen++] = c;
+            } else {
+                // drop the sentence and resync at the next start
+                sawStart = false;
+                overflowCount++;
+                Serial.print("Dropped sentence longer than ");
+                Serial.print(MaxLen);
+                Serial.println(" characters");
+            }
+        }  // else ignore c because we haven't seen a start yet
+    }
 
    public:
     SentenceSerial(HardwareSerial &serial,
@@ -31,32 +60,45 @@ class SentenceSerial {
         serial.write(buffer, size);
     }
 
-    void init(int rxPin, int txPin, int baud = 115200) {
+    // bytes write() can take without blocking
+    int availableForWrite() { return serial.availableForWrite(); }
+
+    // rxBufferSize, if not 0, replaces the default 256 byte receive buffer,
+    // for when more than that can arrive between calls to tick()
+    void init(int rxPin, int txPin, int baud = 115200,
+              size_t rxBufferSize = 0) {
+        if (rxBufferSize > 0) {
+            serial.setRxBufferSize(rxBufferSize);  // must precede begin()
+        }
         serial.begin(baud, SERIAL_8N1, rxPin, txPin);
-        curSentence.reserve(MAX_SENTENCE_LEN + 1);  // +1 for null terminator
     }
 
     // Calling this is not necessary if this serial is write only
     void tick() {
-        while (serial.available()) {
-            char c = serial.read();
-
-            if (c == SENTENCE_START) {
-                curSentence = "";
-                sawStart = true;
-            } else if (c == SENTENCE_END) {
-                processCompletedSentence(curSentence.c_str());
-                sawStart = false;
-            } else if (sawStart) {
-                bool success = curSentence.concat(c);
-                if (!success) {
-                    Serial.println(
-                        "Reading character from scientific serial failed"
-                        " (sentence too long?)");
-                }
-            }  // else ignore c because we haven't seen a start yet
+        readAvailable([this](uint8_t c) { processChar(c); });
+    }
+
+    // Passes every byte received so far to onByte, in chunks so the serial
+    // isn't locked once per byte, and without waiting for more. For reading
+    // something other than sentences; don't also call tick().
+    template <typename OnByte>
+    void readAvailable(OnByte onByte) {
+        uint8_t chunk[READ_CHUNK_SIZE];
+
+        int available;
+        while ((available = serial.available()) > 0) {
+            // never waits, as it asks for at most what is available
+            size_t count = serial.readBytes(
+                chunk, (size_t)available < sizeof(chunk) ? available
+                                                         : sizeof(chunk));
+            for (size_t i = 0; i < count; i++) {
+                onByte(chunk[i]);
+            }
         }
     }
+
+    // sentences dropped for being longer than MaxLen
+    uint32_t getOverflowCount() const { return overflowCount; }
 };
 
-#endif  // SENTENCE_SERIAL_H_
\ No newline at end of file
+#endif  // SENTENCE_SERIAL_H_
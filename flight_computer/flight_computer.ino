@@ -4,6 +4,7 @@
 #include <endian.h>
 
 #include "frequency_logger.h"
+#include "packet_framing.h"
 
 // remember to connect TX to RX and RX to TX
 const int RX_PIN = 47;
@@ -14,13 +15,23 @@ const int DHT_PIN = 2;
 const int SDA_PIN = 21;
 const int SCL_PIN = 20;
 
-// worst case, the delimiter occurs in the data, in which case we drop a packet
-uint8_t PACKET_DELIMITER[] = {0b10101010, 0b01010101};
+const size_t MPU_PAYLOAD_SIZE = 8 + 2 * 6;
+const size_t DHT_PAYLOAD_SIZE = 8 + 4 + 4;
 
 MPU9255 mpu;
 DHT dht(DHT_PIN, DHT11);
 
+// guards Serial2 and the frame sequence numbers
 SemaphoreHandle_t piSerialMutex;
+packet_framing::FrameWriter frameWriter;
+
+// Frames `payload` and writes it to the raspberry pi. Must hold
+// piSerialMutex.
+void writeFrame(const uint8_t *payload, size_t size) {
+    uint8_t frame[packet_framing::maxFrameSize(MPU_PAYLOAD_SIZE)];
+    size_t frameSize = frameWriter.write(payload, size, frame);
+    Serial2.write(frame, frameSize);
+}
 
 // for logging
 FrequencyLogger mpuFreqLogger = FrequencyLogger("MPU", 1000);
@@ -43,16 +54,17 @@ void mpuLoop() {
     uint16_t gy = htons(mpu.gy);
     uint16_t gz = htons(mpu.gz);
 
-    if (xSemaphoreTake(piSerialMutex, portMAX_DELAY)) {
-        Serial2.write((uint8_t *)&ts, sizeof(ts));  // 8 bytes
-        Serial2.write((uint8_t *)&ax, sizeof(ax));  // 2 bytes
-        Serial2.write((uint8_t *)&ay, sizeof(ay));  // 2 bytes
-        Serial2.write((uint8_t *)&az, sizeof(az));  // 2 bytes
-        Serial2.write((uint8_t *)&gx, sizeof(gx));  // 2 bytes
-        Serial2.write((uint8_t *)&gy, sizeof(gy));  // 2 bytes
-        Serial2.write((uint8_t *)&gz, sizeof(gz));  // 2 bytes
+    uint8_t payload[MPU_PAYLOAD_SIZE];
+    memcpy(payload, &ts, sizeof(ts));       // 8 bytes
+    memcpy(payload + 8, &ax, sizeof(ax));   // 2 bytes
+    memcpy(payload + 10, &ay, sizeof(ay));  // 2 bytes
+    memcpy(payload + 12, &az, sizeof(az));  // 2 bytes
+    memcpy(payload + 14, &gx, sizeof(gx));  // 2 bytes
+    memcpy(payload + 16, &gy, sizeof(gy));  // 2 bytes
+    memcpy(payload + 18, &gz, sizeof(gz));  // 2 bytes
 
-        Serial2.write(PACKET_DELIMITER, sizeof(PACKET_DELIMITER));
+    if (xSemaphoreTake(piSerialMutex, portMAX_DELAY)) {
+        writeFrame(payload, sizeof(payload));
 
         xSemaphoreGive(piSerialMutex);
     } else {
@@ -83,12 +95,13 @@ void dhtLoop() {
     uint32_t temp = htonl(*((uint32_t *)&temp_host));
     uint32_t hum = htonl(*((uint32_t *)&hum_host));
 
-    if (xSemaphoreTake(piSerialMutex, portMAX_DELAY)) {
-        Serial2.write((uint8_t *)&ts, sizeof(ts));      // 8 bytes
-        Serial2.write((uint8_t *)&temp, sizeof(temp));  // 4 bytes
-        Serial2.write((uint8_t *)&hum, sizeof(hum));    // 4 bytes
+    uint8_t payload[DHT_PAYLOAD_SIZE];
+    memcpy(payload, &ts, sizeof(ts));          // 8 bytes
+    memcpy(payload + 8, &temp, sizeof(temp));  // 4 bytes
+    memcpy(payload + 12, &hum, sizeof(hum));   // 4 bytes
 
-        Serial2.write(PACKET_DELIMITER, sizeof(PACKET_DELIMITER));
+    if (xSemaphoreTake(piSerialMutex, portMAX_DELAY)) {
+        writeFrame(payload, sizeof(payload));
 
         xSemaphoreGive(piSerialMutex);
     } else {
@@ -11,14 +11,27 @@ const int SYNC_WITH_NETWORK_INTERVAL = 50;
 void setStateReqBody() {
     int64_t timestamp = esp_timer_get_time();
 
+    hardware::SensorValue<long> st1 =
+        hardware::transducer::getSmallTransd1MPSI();
+    hardware::SensorValue<double> thermo1 =
+        hardware::thermocouple::getThermo1Celcius();
+    hardware::SensorValue<double> thermo2 =
+        hardware::thermocouple::getThermo2Celcius();
+
     rockets_client::StaticJsonDoc recordData;
 
     recordData["stateByte"] = interface::getStateByte();
     recordData["relayStatusByte"] = interface::getRelayStatusByte();
-    recordData["st1MPSI"] = hardware::transducer::getSmallTransd1MPSI();
-    recordData["st2MPSI"] = hardware::transducer::getSmallTransd2MPSI();
-    recordData["thermo1C"] = hardware::thermocouple::getThermo1Celcius();
-    recordData["thermo2C"] = hardware::thermocouple::getThermo2Celcius();
+    recordData["st1MPSI"] = st1.value;
+    recordData["st1AgeMs"] = st1.getAgeMs();
+    recordData["st2MPSI"] = hardware::transducer::getSmallTransd2MPSI().value;
+    recordData["thermo1C"] = thermo1.value;
+    // a faulted thermocouple keeps its last good value, so flag it
+    recordData["thermo1Stale"] =
+        thermo1.isStale(hardware::thermocouple::MAX_AGE_MS);
+    recordData["thermo2C"] = thermo2.value;
+    recordData["thermo2Stale"] =
+        thermo2.isStale(hardware::thermocouple::MAX_AGE_MS);
     recordData["timeSinceBoot"] = timestamp,
     recordData["timeSinceCalibration"] =
         timestamp - hardware::getCalibrationTime();
@@ -27,25 +40,23 @@ void setStateReqBody() {
 }
 
 void getCommandResBody() {
-    rockets_client::StaticJsonDoc latestMessage =
-        rockets_client::getLatestMessage();
-
-    auto messageData = latestMessage["data"];
-    if (messageData.isNull()) {
-        // no new message
-        return;
-    }
-
     // sample response: {"data":{"command":"keep"}}
 
-    const char* command = messageData["command"];
-    if (command == NULL) {
-        // no command
+    // copy out just the command, so the message isn't held while acting on it
+    std::string commandStr;
+    rockets_client::borrowLatestMessage(
+        [&](const rockets_client::StaticJsonDoc& latestMessage) {
+            const char* command = latestMessage["data"]["command"];
+            if (command != NULL) {
+                commandStr = command;
+            }
+        });
+
+    if (commandStr.empty()) {
+        // no new message, or no command
         return;
     }
 
-    std::string commandStr(command);
-
     using namespace state;
 
     if (commandStr == RECALIBRATE_COMMAND) {
@@ -101,10 +112,7 @@ void getCommandResBody() {
     }
 }
 
-void syncWithNetwork() {
-    setStateReqBody();
-    getCommandResBody();
-}
+void syncWithNetwork() { setStateReqBody(); }
 
 TickTwo syncWithNetworkTicker(syncWithNetwork, SYNC_WITH_NETWORK_INTERVAL);
 
@@ -125,6 +133,9 @@ void loop() {
     hardware::tick();
 
     syncWithNetworkTicker.update();
+    // commands are checked every loop rather than on the ticker, so that they
+    // take effect as soon as the network task receives them
+    getCommandResBody();
 
     delay(5);
 }
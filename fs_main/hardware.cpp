@@ -7,6 +7,7 @@
 
 #include "Adafruit_MAX31855.h"
 #include "frequency_logger.h"
+#include "packet_framing.h"
 #include "sentence_serial.h"
 
 namespace hardware {
@@ -18,11 +19,15 @@ int64_t calibrationTime = 0;
 
 namespace transducer {
 
-long smallTransd1MPSI = 0;
-long smallTransd2MPSI = 0;
+SensorValue<long> smallTransd1MPSI;
+SensorValue<long> smallTransd2MPSI;
+SensorValue<long> smallTransd1RawMPSI;
+SensorValue<long> smallTransd2RawMPSI;
 
-long getSmallTransd1MPSI() { return smallTransd1MPSI; }
-long getSmallTransd2MPSI() { return smallTransd2MPSI; }
+SensorValue<long> getSmallTransd1MPSI() { return smallTransd1MPSI; }
+SensorValue<long> getSmallTransd2MPSI() { return smallTransd2MPSI; }
+SensorValue<long> getSmallTransd1RawMPSI() { return smallTransd1RawMPSI; }
+SensorValue<long> getSmallTransd2RawMPSI() { return smallTransd2RawMPSI; }
 
 }  // namespace transducer
 
@@ -32,50 +37,75 @@ namespace sciSerial {
 const int RX_PIN = 48;
 const int TX_PIN = 47;
 
+const int BAUD = 921600;
+// the scientific module sends a 31 byte pressures frame per reading, about
+// 860 a second, which would fill the default 256 byte buffer in 10 ms; this
+// is about 300 ms of them, so a slow loop, e.g. while the network task
+// borrows a callback or something prints, doesn't drop any
+const size_t RX_BUFFER_SIZE = 8 * 1024;
+
+// commands to the scientific module are sentences
 const char *RECALIBRATE_SENTENCE = "cal";
 const char *CLEAR_CALIBRATION_SENTENCE = "clear cal";
 
-const char *CALIBRATION_COMPLETE_SENTENCE = "calibrated";
+// messages from the scientific module are packet_framing frames whose first
+// payload byte is the message type
+const uint8_t PRESSURES_MESSAGE = 1;
+const uint8_t CALIBRATED_MESSAGE = 2;
+
+// type, int64 ts, then int32 st1, st2 readings and st1, st2 medians in milli
+// psi, all big endian
+const size_t PRESSURES_PAYLOAD_SIZE = 1 + 8 + 4 * 4;
+
+// sends sentences; bytes received are passed to frameReader
+SentenceSerial<> serial(Serial1, nullptr);
+packet_framing::FrameReader<PRESSURES_PAYLOAD_SIZE> frameReader;
 
-void processCompletedSentence(const char *sentence) {
-    // possibility 1:
-    if (strcmp(sentence, CALIBRATION_COMPLETE_SENTENCE) == 0) {
+void processFrame(const uint8_t *payload, size_t size) {
+    if (size == 1 && payload[0] == CALIBRATED_MESSAGE) {
         calibrationTime = esp_timer_get_time();
 
         Serial.println("Calibration complete");
         return;
     }
 
-    // possibility 2:
-
-    // sentence format: [st1_pressure_mpsi_long] [st2_pressure_mpsi_long]
-    // ex: "123456 123456"
-
-    long st1, st2;
-    int result = sscanf(sentence, "%ld %ld", &st1, &st2);
-
-    if (result == 2) {
-        transducer::smallTransd1MPSI = st1;
-        transducer::smallTransd2MPSI = st2;
+    if (size == PRESSURES_PAYLOAD_SIZE && payload[0] == PRESSURES_MESSAGE) {
+        // the scientific module's ts isn't comparable to ours, so it isn't
+        // used yet
+        transducer::smallTransd1RawMPSI.set(
+            (int32_t)packet_framing::getBigEndian(payload + 9, 4));
+        transducer::smallTransd2RawMPSI.set(
+            (int32_t)packet_framing::getBigEndian(payload + 13, 4));
+        transducer::smallTransd1MPSI.set(
+            (int32_t)packet_framing::getBigEndian(payload + 17, 4));
+        transducer::smallTransd2MPSI.set(
+            (int32_t)packet_framing::getBigEndian(payload + 21, 4));
         return;
     }
 
-    // else: invalid sentence
-    Serial.print("Invalid sentence from scientific module: ");
-    Serial.println(sentence);
+    // else: invalid message
+    Serial.print("Invalid message from scientific module, type ");
+    Serial.print(payload[0]);
+    Serial.print(", size ");
+    Serial.println(size);
 }
 
-SentenceSerial serial(Serial1, processCompletedSentence);
-
 void sendRecalibrateCommand() { serial.sendSentence(RECALIBRATE_SENTENCE); }
 
 void sendClearCalibrationCommand() {
     serial.sendSentence(CLEAR_CALIBRATION_SENTENCE);
 }
 
-void init() { serial.init(RX_PIN, TX_PIN); }
+void init() { serial.init(RX_PIN, TX_PIN, BAUD, RX_BUFFER_SIZE); }
 
-void tick() { serial.tick(); }
+void tick() {
+    serial.readAvailable([](uint8_t c) {
+        if (frameReader.push(c)) {
+            processFrame(frameReader.getPayload(),
+                         frameReader.getPayloadSize());
+        }
+    });
+}
 
 }  // namespace sciSerial
 
@@ -197,11 +227,11 @@ SPIClass fspi(FSPI);
 Adafruit_MAX31855 thermo1(CS1_PIN, &fspi);
 Adafruit_MAX31855 thermo2(CS2_PIN, &fspi);
 
-double thermo1Celcius = 0;
-double thermo2Celcius = 0;
+SensorValue<double> thermo1Celcius;
+SensorValue<double> thermo2Celcius;
 
-double getThermo1Celcius() { return thermo1Celcius; }
-double getThermo2Celcius() { return thermo2Celcius; }
+SensorValue<double> getThermo1Celcius() { return thermo1Celcius; }
+SensorValue<double> getThermo2Celcius() { return thermo2Celcius; }
 
 void printError(uint8_t error) {
     if (error & MAX31855_FAULT_OPEN) {
@@ -219,22 +249,18 @@ void printError(uint8_t error) {
 void read() {
     double c1 = thermo1.readCelsius();
     if (isnan(c1)) {
-        thermo1Celcius = 0;
-
         Serial.print("thermo1 fault(s) detected: ");
         printError(thermo1.readError());
     } else {
-        thermo1Celcius = c1;
+        thermo1Celcius.set(c1);
     }
 
     double c2 = thermo2.readCelsius();
     if (isnan(c2)) {
-        thermo2Celcius = 0;
-
         Serial.print("thermo2 fault(s) detected: ");
         printError(thermo2.readError());
     } else {
-        thermo2Celcius = c2;
+        thermo2Celcius.set(c2);
     }
 }
 
@@ -5,6 +5,36 @@
 
 namespace hardware {
 
+// A sensor value with when it arrived, so users can tell how old it is.
+template <typename T>
+struct SensorValue {
+    T value = 0;
+    // esp_timer_get_time() when the value arrived
+    int64_t arrivalTs = 0;
+    // values that have arrived so far; 0 if none has, in which case value is
+    // meaningless
+    uint32_t seq = 0;
+
+    void set(T newValue) {
+        value = newValue;
+        arrivalTs = esp_timer_get_time();
+        seq++;
+    }
+
+    // -1 if no value has arrived
+    int64_t getAgeMs() const {
+        if (seq == 0) {
+            return -1;
+        }
+        return (esp_timer_get_time() - arrivalTs) / 1000;
+    }
+
+    // also true if no value has arrived
+    bool isStale(int64_t maxAgeMs) const {
+        return seq == 0 || getAgeMs() > maxAgeMs;
+    }
+};
+
 namespace sciSerial {
 
 void sendRecalibrateCommand();
@@ -35,8 +65,11 @@ void setServoValveAttached(bool attached);
 
 namespace thermocouple {
 
-double getThermo1Celcius();
-double getThermo2Celcius();
+// read every 100ms; faults leave the last good value to go stale
+const int64_t MAX_AGE_MS = 500;
+
+SensorValue<double> getThermo1Celcius();
+SensorValue<double> getThermo2Celcius();
 
 }  // namespace thermocouple
 
@@ -50,8 +83,17 @@ const long ABORT_MPSI = 900000;
 // buffer to prevent oscillation
 const long BUFFER_MPSI = 5000;
 
-long getSmallTransd1MPSI();
-long getSmallTransd2MPSI();
+// readings arrive from the scientific module at up to 860 Hz; older than this
+// means the link or the module is down
+const int64_t MAX_AGE_MS = 100;
+
+// medians, as used for the filling sequence
+SensorValue<long> getSmallTransd1MPSI();
+SensorValue<long> getSmallTransd2MPSI();
+
+// latest readings
+SensorValue<long> getSmallTransd1RawMPSI();
+SensorValue<long> getSmallTransd2RawMPSI();
 
 }  // namespace transducer
 
@@ -78,123 +78,336 @@ enum class State {
     CUSTOM,
 };
 
+// relay outputs of a state, as bits
+namespace output {
+const uint8_t FILL = 1 << 0;
+const uint8_t VENT = 1 << 1;
+const uint8_t ABORT = 1 << 2;
+const uint8_t PYRO_CUTTER = 1 << 3;
+const uint8_t IGNITER = 1 << 4;
+const uint8_t SERVO_VALVE = 1 << 5;
+const uint8_t SERVO_VALVE_ATTACHED = 1 << 6;
+// the relays set by setOpStateToCustom()
+const uint8_t CUSTOM = 1 << 7;
+}  // namespace output
+
+// conditions for leaving a state
+enum class Condition : uint8_t {
+    never,  // for unused transitions
+    // pressure conditions for ox tank, including buffer to prevent
+    // oscillation
+    pAboveAbort,
+    pBelowAbort,
+    pAboveMax,
+    pBelowMax,
+    pAboveMin,
+    pBelowMin,
+    // the state's timeoutMs has passed
+    timeout,
+};
+
+const int CONDITION_COUNT = (int)Condition::timeout + 1;
+
+struct Transition {
+    Condition condition;
+    State next;
+};
+
+const int MAX_TRANSITIONS = 2;
+
+struct StateInfo {
+    State state;  // the row's own state, to check the table's order
+    OpState opState;
+    uint8_t outputs;
+    // checked in order; the first whose condition holds is taken
+    Transition transitions[MAX_TRANSITIONS];
+    unsigned long timeoutMs;
+    // where to go if the pressure is stale in a state that depends on it:
+    // STANDBY for states that add pressure, and the state itself, to hold it
+    // without acting on the old pressure, for states that vent or hold it
+    State staleFallback;
+};
+
+// One row per State, in the same order. Unused transitions are left out, and
+// default to Condition::never. staleFallback is only used by rows with a
+// pressure transition; the rest point at themselves.
+constexpr StateInfo STATE_TABLE[] = {
+    // standby
+    {State::STANDBY, OpState::standby, 0, {}, 0, State::STANDBY},
+    // keep
+    {State::KEEP_P_IN_RANGE,
+     OpState::keep,
+     0,
+     {{Condition::pAboveMax, State::KEEP_P_ABOVE_MAX},
+      {Condition::pBelowMin, State::KEEP_P_BELOW_MIN}},
+     0,
+     State::KEEP_P_IN_RANGE},
+    {State::KEEP_P_ABOVE_MAX,
+     OpState::keep,
+     output::VENT,
+     {{Condition::pBelowMax, State::KEEP_P_IN_RANGE}},
+     0,
+     State::KEEP_P_ABOVE_MAX},
+    {State::KEEP_P_BELOW_MIN,
+     OpState::keep,
+     output::FILL,
+     {{Condition::pAboveMin, State::KEEP_P_IN_RANGE}},
+     0,
+     State::STANDBY},
+    // fill
+    {State::FILL_P_ABOVE_ABORT,
+     OpState::fill,
+     output::VENT,
+     {{Condition::pBelowAbort, State::FILL_P_BELOW_ABORT}},
+     0,
+     State::FILL_P_ABOVE_ABORT},
+    {State::FILL_P_BELOW_ABORT,
+     OpState::fill,
+     output::FILL,
+     {{Condition::pAboveAbort, State::FILL_P_ABOVE_ABORT}},
+     0,
+     State::STANDBY},
+    // purge
+    {State::PURGE_P_ABOVE_ABORT,
+     OpState::purge,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PURGE_P_BELOW_ABORT}},
+     0,
+     State::PURGE_P_ABOVE_ABORT},
+    {State::PURGE_P_BELOW_ABORT,
+     OpState::purge,
+     output::FILL | output::VENT,
+     {{Condition::pAboveAbort, State::PURGE_P_ABOVE_ABORT}},
+     0,
+     State::STANDBY},
+    // pulse-fill-A
+    {State::PULSE_FILL_A_P_ABOVE_ABORT,
+     OpState::pulseFillA,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PULSE_FILL_A_P_BELOW_ABORT}},
+     0,
+     State::PULSE_FILL_A_P_ABOVE_ABORT},
+    {State::PULSE_FILL_A_P_BELOW_ABORT,
+     OpState::pulseFillA,
+     output::FILL,
+     {{Condition::pAboveAbort, State::PULSE_FILL_A_P_ABOVE_ABORT},
+      {Condition::timeout, State::STANDBY}},
+     PULSE_FILL_A_TIME,
+     State::STANDBY},
+    // pulse-fill-B
+    {State::PULSE_FILL_B_P_ABOVE_ABORT,
+     OpState::pulseFillB,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PULSE_FILL_B_P_BELOW_ABORT}},
+     0,
+     State::PULSE_FILL_B_P_ABOVE_ABORT},
+    {State::PULSE_FILL_B_P_BELOW_ABORT,
+     OpState::pulseFillB,
+     output::FILL,
+     {{Condition::pAboveAbort, State::PULSE_FILL_B_P_ABOVE_ABORT},
+      {Condition::timeout, State::STANDBY}},
+     PULSE_FILL_B_TIME,
+     State::STANDBY},
+    // pulse-fill-C
+    {State::PULSE_FILL_C_P_ABOVE_ABORT,
+     OpState::pulseFillC,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PULSE_FILL_C_P_BELOW_ABORT}},
+     0,
+     State::PULSE_FILL_C_P_ABOVE_ABORT},
+    {State::PULSE_FILL_C_P_BELOW_ABORT,
+     OpState::pulseFillC,
+     output::FILL,
+     {{Condition::pAboveAbort, State::PULSE_FILL_C_P_ABOVE_ABORT},
+      {Condition::timeout, State::STANDBY}},
+     PULSE_FILL_C_TIME,
+     State::STANDBY},
+    // pulse-vent-A
+    {State::PULSE_VENT_A,
+     OpState::pulseVentA,
+     output::VENT,
+     {{Condition::timeout, State::STANDBY}},
+     PULSE_VENT_A_TIME,
+     State::PULSE_VENT_A},
+    // pulse-vent-B
+    {State::PULSE_VENT_B,
+     OpState::pulseVentB,
+     output::VENT,
+     {{Condition::timeout, State::STANDBY}},
+     PULSE_VENT_B_TIME,
+     State::PULSE_VENT_B},
+    // pulse-vent-C
+    {State::PULSE_VENT_C,
+     OpState::pulseVentC,
+     output::VENT,
+     {{Condition::timeout, State::STANDBY}},
+     PULSE_VENT_C_TIME,
+     State::PULSE_VENT_C},
+    // pulse-purge-A
+    {State::PULSE_PURGE_A_P_ABOVE_ABORT,
+     OpState::pulsePurgeA,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PULSE_PURGE_A_P_BELOW_ABORT}},
+     0,
+     State::PULSE_PURGE_A_P_ABOVE_ABORT},
+    {State::PULSE_PURGE_A_P_BELOW_ABORT,
+     OpState::pulsePurgeA,
+     output::FILL | output::VENT,
+     {{Condition::pAboveAbort, State::PULSE_PURGE_A_P_ABOVE_ABORT},
+      {Condition::timeout, State::STANDBY}},
+     PULSE_PURGE_A_TIME,
+     State::STANDBY},
+    // pulse-purge-B
+    {State::PULSE_PURGE_B_P_ABOVE_ABORT,
+     OpState::pulsePurgeB,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PULSE_PURGE_B_P_BELOW_ABORT}},
+     0,
+     State::PULSE_PURGE_B_P_ABOVE_ABORT},
+    {State::PULSE_PURGE_B_P_BELOW_ABORT,
+     OpState::pulsePurgeB,
+     output::FILL | output::VENT,
+     {{Condition::pAboveAbort, State::PULSE_PURGE_B_P_ABOVE_ABORT},
+      {Condition::timeout, State::STANDBY}},
+     PULSE_PURGE_B_TIME,
+     State::STANDBY},
+    // pulse-purge-C
+    {State::PULSE_PURGE_C_P_ABOVE_ABORT,
+     OpState::pulsePurgeC,
+     output::VENT,
+     {{Condition::pBelowAbort, State::PULSE_PURGE_C_P_BELOW_ABORT}},
+     0,
+     State::PULSE_PURGE_C_P_ABOVE_ABORT},
+    {State::PULSE_PURGE_C_P_BELOW_ABORT,
+     OpState::pulsePurgeC,
+     output::FILL | output::VENT,
+     {{Condition::pAboveAbort, State::PULSE_PURGE_C_P_ABOVE_ABORT},
+      {Condition::timeout, State::STANDBY}},
+     PULSE_PURGE_C_TIME,
+     State::STANDBY},
+    // fire
+    {State::FIRE_PYRO_CUTTER,
+     OpState::fire,
+     output::PYRO_CUTTER | output::SERVO_VALVE_ATTACHED,
+     {{Condition::timeout, State::FIRE_IGNITER}},
+     FIRE_PYRO_CUTTER_TIME,
+     State::FIRE_PYRO_CUTTER},
+    {State::FIRE_IGNITER,
+     OpState::fire,
+     output::PYRO_CUTTER | output::IGNITER | output::SERVO_VALVE_ATTACHED,
+     {{Condition::timeout, State::FIRE_PYRO_VALVE}},
+     FIRE_IGNITER_TIME,
+     State::FIRE_IGNITER},
+    {State::FIRE_PYRO_VALVE,
+     OpState::fire,
+     output::PYRO_CUTTER | output::IGNITER | output::SERVO_VALVE |
+         output::SERVO_VALVE_ATTACHED,
+     {},
+     0,
+     State::FIRE_PYRO_VALVE},
+    // fire-manual-igniter
+    {State::FIRE_MANUAL_IGNITER,
+     OpState::fireManualIgniter,
+     output::IGNITER | output::SERVO_VALVE_ATTACHED,
+     {},
+     0,
+     State::FIRE_MANUAL_IGNITER},
+    // fire-manual-valve
+    {State::FIRE_MANUAL_VALVE,
+     OpState::fireManualValve,
+     output::SERVO_VALVE | output::SERVO_VALVE_ATTACHED,
+     {},
+     0,
+     State::FIRE_MANUAL_VALVE},
+    // abort
+    {State::ABORT, OpState::abort, output::ABORT, {}, 0, State::ABORT},
+    // custom
+    {State::CUSTOM, OpState::custom, output::CUSTOM, {}, 0, State::CUSTOM},
+};
+
+const int STATE_COUNT = sizeof(STATE_TABLE) / sizeof(STATE_TABLE[0]);
+
+constexpr bool isStateTableInOrder(int i) {
+    return i == STATE_COUNT ||
+           (STATE_TABLE[i].state == (State)i && isStateTableInOrder(i + 1));
+}
+
+static_assert(STATE_COUNT == (int)State::CUSTOM + 1,
+              "STATE_TABLE needs a row per State");
+static_assert(isStateTableInOrder(0),
+              "STATE_TABLE rows must be in the same order as State");
+
+constexpr bool isPressureCondition(Condition condition) {
+    return condition != Condition::never && condition != Condition::timeout;
+}
+
+// whether `info` opens or closes valves based on the pressure
+constexpr bool isPressureControlled(const StateInfo &info, int i = 0) {
+    return i < MAX_TRANSITIONS &&
+           (isPressureCondition(info.transitions[i].condition) ||
+            isPressureControlled(info, i + 1));
+}
+
+// a stale pressure must never leave the fill valve open
+constexpr bool areStaleFallbacksSafe(int i) {
+    return i == STATE_COUNT ||
+           ((!isPressureControlled(STATE_TABLE[i]) ||
+             !(STATE_TABLE[(int)STATE_TABLE[i].staleFallback].outputs &
+               output::FILL)) &&
+            areStaleFallbacksSafe(i + 1));
+}
+
+static_assert(areStaleFallbacksSafe(0),
+              "staleFallback must not fill the tank");
+
+// the state each OpState starts in, in the same order as OpState
+constexpr State ENTRY_STATES[] = {
+    State::STANDBY,                      // standby
+    State::KEEP_P_IN_RANGE,              // keep
+    State::FILL_P_BELOW_ABORT,           // fill
+    State::PURGE_P_BELOW_ABORT,          // purge
+    State::PULSE_FILL_A_P_BELOW_ABORT,   // pulseFillA
+    State::PULSE_FILL_B_P_BELOW_ABORT,   // pulseFillB
+    State::PULSE_FILL_C_P_BELOW_ABORT,   // pulseFillC
+    State::PULSE_VENT_A,                 // pulseVentA
+    State::PULSE_VENT_B,                 // pulseVentB
+    State::PULSE_VENT_C,                 // pulseVentC
+    State::PULSE_PURGE_A_P_BELOW_ABORT,  // pulsePurgeA
+    State::PULSE_PURGE_B_P_BELOW_ABORT,  // pulsePurgeB
+    State::PULSE_PURGE_C_P_BELOW_ABORT,  // pulsePurgeC
+    State::FIRE_PYRO_CUTTER,             // fire
+    State::FIRE_MANUAL_IGNITER,          // fireManualIgniter
+    State::FIRE_MANUAL_VALVE,            // fireManualValve
+    State::ABORT,                        // abort
+    State::CUSTOM,                       // custom
+};
+
+static_assert(sizeof(ENTRY_STATES) / sizeof(ENTRY_STATES[0]) ==
+                  (int)OpState::custom + 1,
+              "ENTRY_STATES needs an entry per OpState");
+
 State curState;
 interface::RelayStatus customRelayStatus;
 
 // time when current curState was entered
 unsigned long enteredStateMillis;
 
+// to only log a held state once while the pressure stays stale
+bool pressureWasStale = false;
+
+const StateInfo &curStateInfo() { return STATE_TABLE[(int)curState]; }
+
 void enterState(State state) {
     curState = state;
     enteredStateMillis = millis();
 }
 
-OpState getOpState() {
-    switch (curState) {
-        case State::STANDBY:
-            return OpState::standby;
-        case State::KEEP_P_IN_RANGE:
-        case State::KEEP_P_ABOVE_MAX:
-        case State::KEEP_P_BELOW_MIN:
-            return OpState::keep;
-        case State::FILL_P_ABOVE_ABORT:
-        case State::FILL_P_BELOW_ABORT:
-            return OpState::fill;
-        case State::PURGE_P_ABOVE_ABORT:
-        case State::PURGE_P_BELOW_ABORT:
-            return OpState::purge;
-        case State::PULSE_FILL_A_P_ABOVE_ABORT:
-        case State::PULSE_FILL_A_P_BELOW_ABORT:
-            return OpState::pulseFillA;
-        case State::PULSE_FILL_B_P_ABOVE_ABORT:
-        case State::PULSE_FILL_B_P_BELOW_ABORT:
-            return OpState::pulseFillB;
-        case State::PULSE_FILL_C_P_ABOVE_ABORT:
-        case State::PULSE_FILL_C_P_BELOW_ABORT:
-            return OpState::pulseFillC;
-        case State::PULSE_VENT_A:
-            return OpState::pulseVentA;
-        case State::PULSE_VENT_B:
-            return OpState::pulseVentB;
-        case State::PULSE_VENT_C:
-            return OpState::pulseVentC;
-        case State::PULSE_PURGE_A_P_ABOVE_ABORT:
-        case State::PULSE_PURGE_A_P_BELOW_ABORT:
-            return OpState::pulsePurgeA;
-        case State::PULSE_PURGE_B_P_ABOVE_ABORT:
-        case State::PULSE_PURGE_B_P_BELOW_ABORT:
-            return OpState::pulsePurgeB;
-        case State::PULSE_PURGE_C_P_ABOVE_ABORT:
-        case State::PULSE_PURGE_C_P_BELOW_ABORT:
-            return OpState::pulsePurgeC;
-        case State::FIRE_PYRO_CUTTER:
-        case State::FIRE_IGNITER:
-        case State::FIRE_PYRO_VALVE:
-            return OpState::fire;
-        case State::FIRE_MANUAL_IGNITER:
-            return OpState::fireManualIgniter;
-        case State::FIRE_MANUAL_VALVE:
-            return OpState::fireManualValve;
-        case State::ABORT:
-            return OpState::abort;
-        case State::CUSTOM:
-            return OpState::custom;
-    }
-}
+OpState getOpState() { return curStateInfo().opState; }
 
 void setOpState(OpState opState) {
-    switch (opState) {
-        case OpState::standby:
-            enterState(State::STANDBY);
-            break;
-        case OpState::keep:
-            enterState(State::KEEP_P_IN_RANGE);
-            break;
-        case OpState::fill:
-            enterState(State::FILL_P_BELOW_ABORT);
-            break;
-        case OpState::purge:
-            enterState(State::PURGE_P_BELOW_ABORT);
-            break;
-        case OpState::pulseFillA:
-            enterState(State::PULSE_FILL_A_P_BELOW_ABORT);
-            break;
-        case OpState::pulseFillB:
-            enterState(State::PULSE_FILL_B_P_BELOW_ABORT);
-            break;
-        case OpState::pulseFillC:
-            enterState(State::PULSE_FILL_C_P_BELOW_ABORT);
-            break;
-        case OpState::pulseVentA:
-            enterState(State::PULSE_VENT_A);
-            break;
-        case OpState::pulseVentB:
-            enterState(State::PULSE_VENT_B);
-            break;
-        case OpState::pulseVentC:
-            enterState(State::PULSE_VENT_C);
-            break;
-        case OpState::pulsePurgeA:
-            enterState(State::PULSE_PURGE_A_P_BELOW_ABORT);
-            break;
-        case OpState::pulsePurgeB:
-            enterState(State::PULSE_PURGE_B_P_BELOW_ABORT);
-            break;
-        case OpState::pulsePurgeC:
-            enterState(State::PULSE_PURGE_C_P_BELOW_ABORT);
-            break;
-        case OpState::fire:
-            enterState(State::FIRE_PYRO_CUTTER);
-            break;
-        case OpState::fireManualIgniter:
-            enterState(State::FIRE_MANUAL_IGNITER);
-            break;
-        case OpState::fireManualValve:
-            enterState(State::FIRE_MANUAL_VALVE);
-            break;
-        case OpState::abort:
-            enterState(State::ABORT);
-            break;
+    // custom needs its relays, see setOpStateToCustom()
+    if (opState != OpState::custom) {
+        enterState(ENTRY_STATES[(int)opState]);
     }
 
     Serial.print("Set op state: ");
@@ -212,170 +425,50 @@ void setOpStateToCustom(byte relayStatusByte) {
 void runStateTransition() {
     using namespace hardware;
 
+    const StateInfo &info = curStateInfo();
     unsigned long timeInState = millis() - enteredStateMillis;
-    long pressure = hardware::transducer::getSmallTransd1MPSI();
-
-    // conditions for ox tank, including buffer to prevent oscillation
-
-    bool pAboveAbort =
-        pressure > transducer::ABORT_MPSI + transducer::BUFFER_MPSI;
-    bool pBelowAbort =
-        pressure < transducer::ABORT_MPSI - transducer::BUFFER_MPSI;
-
-    bool pAboveMax = pressure > transducer::MAX_MPSI + transducer::BUFFER_MPSI;
-    bool pBelowMax = pressure < transducer::MAX_MPSI - transducer::BUFFER_MPSI;
-
-    bool pAboveMin = pressure > transducer::MIN_MPSI + transducer::BUFFER_MPSI;
-    bool pBelowMin = pressure < transducer::MIN_MPSI - transducer::BUFFER_MPSI;
-
-    switch (curState) {
-        // keep
-        case State::KEEP_P_IN_RANGE:
-            if (pAboveMax) {
-                enterState(State::KEEP_P_ABOVE_MAX);
-            } else if (pBelowMin) {
-                enterState(State::KEEP_P_BELOW_MIN);
-            }
-            break;
-        case State::KEEP_P_ABOVE_MAX:
-            if (pBelowMax) {
-                enterState(State::KEEP_P_IN_RANGE);
-            }
-            break;
-        case State::KEEP_P_BELOW_MIN:
-            if (pAboveMin) {
-                enterState(State::KEEP_P_IN_RANGE);
-            }
-            break;
-        // fill
-        case State::FILL_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::FILL_P_BELOW_ABORT);
-            }
-            break;
-        case State::FILL_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::FILL_P_ABOVE_ABORT);
-            }
-            break;
-        // purge
-        case State::PURGE_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PURGE_P_BELOW_ABORT);
-            }
-            break;
-        case State::PURGE_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PURGE_P_ABOVE_ABORT);
-            }
-            break;
-        // pulse-fill-A
-        case State::PULSE_FILL_A_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PULSE_FILL_A_P_BELOW_ABORT);
-            }
-            break;
-        case State::PULSE_FILL_A_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PULSE_FILL_A_P_ABOVE_ABORT);
-            } else if (timeInState > PULSE_FILL_A_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-fill-B
-        case State::PULSE_FILL_B_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PULSE_FILL_B_P_BELOW_ABORT);
-            }
-            break;
-        case State::PULSE_FILL_B_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PULSE_FILL_B_P_ABOVE_ABORT);
-            } else if (timeInState > PULSE_FILL_B_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-fill-C
-        case State::PULSE_FILL_C_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PULSE_FILL_C_P_BELOW_ABORT);
-            }
-            break;
-        case State::PULSE_FILL_C_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PULSE_FILL_C_P_ABOVE_ABORT);
-            } else if (timeInState > PULSE_FILL_C_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-vent-A
-        case State::PULSE_VENT_A:
-            if (timeInState > PULSE_VENT_A_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-vent-B
-        case State::PULSE_VENT_B:
-            if (timeInState > PULSE_VENT_B_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-vent-C
-        case State::PULSE_VENT_C:
-            if (timeInState > PULSE_VENT_C_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-purge-A
-        case State::PULSE_PURGE_A_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PULSE_PURGE_A_P_BELOW_ABORT);
-            }
-            break;
-        case State::PULSE_PURGE_A_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PULSE_PURGE_A_P_ABOVE_ABORT);
-            } else if (timeInState > PULSE_PURGE_A_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-purge-B
-        case State::PULSE_PURGE_B_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PULSE_PURGE_B_P_BELOW_ABORT);
-            }
-            break;
-        case State::PULSE_PURGE_B_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PULSE_PURGE_B_P_ABOVE_ABORT);
-            } else if (timeInState > PULSE_PURGE_B_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // pulse-purge-C
-        case State::PULSE_PURGE_C_P_ABOVE_ABORT:
-            if (pBelowAbort) {
-                enterState(State::PULSE_PURGE_C_P_BELOW_ABORT);
-            }
-            break;
-        case State::PULSE_PURGE_C_P_BELOW_ABORT:
-            if (pAboveAbort) {
-                enterState(State::PULSE_PURGE_C_P_ABOVE_ABORT);
-            } else if (timeInState > PULSE_PURGE_C_TIME) {
-                enterState(State::STANDBY);
-            }
-            break;
-        // fire
-        case State::FIRE_PYRO_CUTTER:
-            if (timeInState > FIRE_PYRO_CUTTER_TIME) {
-                enterState(State::FIRE_IGNITER);
-            }
-            break;
-        case State::FIRE_IGNITER:
-            if (timeInState > FIRE_IGNITER_TIME) {
-                enterState(State::FIRE_PYRO_VALVE);
-            }
-            break;
+    SensorValue<long> st1 = transducer::getSmallTransd1MPSI();
+    long pressure = st1.value;
+
+    // never act on an old pressure, e.g. if the link to the scientific module
+    // is down; stop filling, but keep venting an overpressured tank
+    bool stale = isPressureControlled(info) &&
+                 st1.isStale(transducer::MAX_AGE_MS);
+    if (stale) {
+        if (!pressureWasStale || info.staleFallback != curState) {
+            Serial.print("Pressure is stale (age ");
+            Serial.print((long)st1.getAgeMs());
+            Serial.print("ms), ");
+            Serial.println(info.staleFallback == curState
+                               ? "holding state"
+                               : "entered fallback state");
+        }
+        pressureWasStale = true;
+        if (info.staleFallback != curState) {
+            enterState(info.staleFallback);
+        }
+        return;
+    }
+    pressureWasStale = false;
+
+    // indexed by Condition
+    bool conditions[CONDITION_COUNT] = {
+        false,  // never
+        pressure > transducer::ABORT_MPSI + transducer::BUFFER_MPSI,
+        pressure < transducer::ABORT_MPSI - transducer::BUFFER_MPSI,
+        pressure > transducer::MAX_MPSI + transducer::BUFFER_MPSI,
+        pressure < transducer::MAX_MPSI - transducer::BUFFER_MPSI,
+        pressure > transducer::MIN_MPSI + transducer::BUFFER_MPSI,
+        pressure < transducer::MIN_MPSI - transducer::BUFFER_MPSI,
+        timeInState > info.timeoutMs,
+    };
+
+    for (int i = 0; i < MAX_TRANSITIONS; i++) {
+        const Transition &transition = info.transitions[i];
+        if (conditions[(int)transition.condition]) {
+            enterState(transition.next);
+            return;
+        }
     }
 }
 
@@ -390,144 +483,28 @@ void tick() {
     // run transition first, then update relays
     runStateTransition();
 
-    // first reset relays; note that values aren't flushed to relays until
-    // hardware::tick()
-    setFill(false);
-    setVent(false);
-    setAbort(false);
-    setPyroCutter(false);
-    setServoValve(false);
-    setIgniter(false);
-    setServoValveAttached(false);
-
-    // Moore state machine 🤓
-    switch (curState) {
-        // standby
-        case State::STANDBY:
-            break;  // leave all relays off
-        // keep
-        case State::KEEP_P_IN_RANGE:
-            break;  // leave all relays off
-        case State::KEEP_P_ABOVE_MAX:
-            setVent(true);
-            break;
-        case State::KEEP_P_BELOW_MIN:
-            setFill(true);
-            break;
-        // fill
-        case State::FILL_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::FILL_P_BELOW_ABORT:
-            setFill(true);
-            break;
-        // purge
-        case State::PURGE_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PURGE_P_BELOW_ABORT:
-            setFill(true);
-            setVent(true);
-            break;
-        // pulse-fill-A
-        case State::PULSE_FILL_A_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PULSE_FILL_A_P_BELOW_ABORT:
-            setFill(true);
-            break;
-        // pulse-fill-B
-        case State::PULSE_FILL_B_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PULSE_FILL_B_P_BELOW_ABORT:
-            setFill(true);
-            break;
-        // pulse-fill-C
-        case State::PULSE_FILL_C_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PULSE_FILL_C_P_BELOW_ABORT:
-            setFill(true);
-            break;
-        // pulse-vent-A
-        case State::PULSE_VENT_A:
-            setVent(true);
-            break;
-        // pulse-vent-B
-        case State::PULSE_VENT_B:
-            setVent(true);
-            break;
-        // pulse-vent-C
-        case State::PULSE_VENT_C:
-            setVent(true);
-            break;
-        // pulse-purge-A
-        case State::PULSE_PURGE_A_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PULSE_PURGE_A_P_BELOW_ABORT:
-            setFill(true);
-            setVent(true);
-            break;
-        // pulse-purge-B
-        case State::PULSE_PURGE_B_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PULSE_PURGE_B_P_BELOW_ABORT:
-            setFill(true);
-            setVent(true);
-            break;
-        // pulse-purge-C
-        case State::PULSE_PURGE_C_P_ABOVE_ABORT:
-            setVent(true);
-            break;
-        case State::PULSE_PURGE_C_P_BELOW_ABORT:
-            setFill(true);
-            setVent(true);
-            break;
-        // fire
-        case State::FIRE_PYRO_CUTTER:
-            setPyroCutter(true);
-            setServoValveAttached(true);
-            break;
-        case State::FIRE_IGNITER:
-            setPyroCutter(true);
-            setIgniter(true);
-            setServoValveAttached(true);
-            break;
-        case State::FIRE_PYRO_VALVE:
-            setPyroCutter(true);
-            setIgniter(true);
-            setServoValve(true);
-            setServoValveAttached(true);
-            break;
-        // fire-manual-igniter
-        case State::FIRE_MANUAL_IGNITER:
-            setIgniter(true);
-            setServoValveAttached(true);
-            break;
-        // fire-manual-valve
-        case State::FIRE_MANUAL_VALVE:
-            setServoValve(true);
-            setServoValveAttached(true);
-            break;
-        // abort
-        case State::ABORT:
-            setAbort(true);
-            break;
-        // custom
-        case State::CUSTOM:
-            setFill(customRelayStatus.fill);
-            setVent(customRelayStatus.vent);
-            setAbort(customRelayStatus.abort);
-            setPyroCutter(customRelayStatus.pyroCutter);
-            setIgniter(customRelayStatus.igniter);
-            setServoValve(customRelayStatus.servoValve);
-            // temporary until we switch away from a servo valve
-            setServoValveAttached(customRelayStatus.servoValve);
-            break;
+    // note that values aren't flushed to relays until hardware::tick()
+    uint8_t outputs = curStateInfo().outputs;
+
+    if (outputs & output::CUSTOM) {
+        setFill(customRelayStatus.fill);
+        setVent(customRelayStatus.vent);
+        setAbort(customRelayStatus.abort);
+        setPyroCutter(customRelayStatus.pyroCutter);
+        setIgniter(customRelayStatus.igniter);
+        setServoValve(customRelayStatus.servoValve);
+        // temporary until we switch away from a servo valve
+        setServoValveAttached(customRelayStatus.servoValve);
+        return;
     }
+
+    setFill(outputs & output::FILL);
+    setVent(outputs & output::VENT);
+    setAbort(outputs & output::ABORT);
+    setPyroCutter(outputs & output::PYRO_CUTTER);
+    setIgniter(outputs & output::IGNITER);
+    setServoValve(outputs & output::SERVO_VALVE);
+    setServoValveAttached(outputs & output::SERVO_VALVE_ATTACHED);
 }
 
-}  // namespace state
\ No newline at end of file
+}  // namespace state
@@ -1,10 +1,11 @@
 #include <EEPROM.h>
-#include <TickTwo.h>
-#include <endian.h>
 
+#include "batch_encoder.h"
 #include "frequency_logger.h"
 #include "moving_median_adc.h"
+#include "packet_framing.h"
 #include "sentence_serial.h"
+#include "serial_tx_queue.h"
 
 const bool PRINT_DEBUG = false;
 
@@ -38,6 +39,11 @@ const uint16_t ADC2_RATE = RATE_ADS1115_860SPS;
 const adsGain_t ADC1_GAIN = GAIN_TWOTHIRDS;
 const adsGain_t ADC2_GAIN = GAIN_TWOTHIRDS;
 
+// GPIOs wired to the ALERT/RDY pins, or -1 if not wired, in which case the ADC
+// is polled at its data rate
+const int ADC1_ALERT_PIN = -1;
+const int ADC2_ALERT_PIN = -1;
+
 // device constants
 
 const ADCMode SMALL_TRANSD_1_ADC_MODE = ADCMode::SingleEnded_2;
@@ -51,12 +57,17 @@ const float SMALL_TRANSD_2_MPSI_PER_VOLT = 1000 / 0.00341944869;
 Adafruit_ADS1115 adc1;
 Adafruit_ADS1115 adc2;
 
-MovingMedianADC<Adafruit_ADS1115> smallTransd1ADC("small transducer 1",
-                                                  ADC_MEDIAN_WINDOW_SIZE, adc1,
-                                                  SMALL_TRANSD_1_ADC_MODE);
-MovingMedianADC<Adafruit_ADS1115> smallTransd2ADC("small transducer 2",
-                                                  ADC_MEDIAN_WINDOW_SIZE, adc2,
-                                                  SMALL_TRANSD_2_ADC_MODE);
+typedef MovingMedianADC<Adafruit_ADS1115, ADC_MEDIAN_WINDOW_SIZE,
+                        ADC_CALIBRATE_SAMPLE_COUNT>
+    TransducerADC;
+
+TransducerADC smallTransd1ADC("small transducer 1", adc1,
+                              SMALL_TRANSD_1_ADC_MODE);
+TransducerADC smallTransd2ADC("small transducer 2", adc2,
+                              SMALL_TRANSD_2_ADC_MODE);
+
+// true from a recalibrate command until every ADC has its new zero
+bool recalibrating = false;
 
 void recalibrate();
 void clearCalibration();
@@ -68,30 +79,62 @@ namespace piSerial {
 const int RX_PIN = 14;
 const int TX_PIN = 13;
 
-// worst case, the delimiter occurs in the data, in which case we drop a packet
-uint8_t PACKET_DELIMITER[] = {0b10101010, 0b01010101};
+// samples per frame; each frame is sent once full, or once its first sample
+// is BATCH_MAX_AGE_US old
+const int BATCH_SIZE = 16;
+const int64_t BATCH_MAX_AGE_US = 100 * 1000;
 
-void init() { Serial2.begin(PI_BAUD, SERIAL_8N1, RX_PIN, TX_PIN); }
+typedef BatchEncoder<2, BATCH_SIZE> Batch;
+const size_t MAX_FRAME_SIZE =
+    packet_framing::maxFrameSize(Batch::MAX_PAYLOAD_SIZE);
 
-void tick() {
-    int64_t ts_host = esp_timer_get_time();
+Batch batch;
+packet_framing::FrameWriter frameWriter;
+
+// frames waiting for the UART, so sampling never waits on the serial; about
+// 180ms of data at PI_BAUD, on top of the UART driver's own TX buffer
+const size_t TX_QUEUE_SIZE = 4096;
+const size_t UART_TX_BUFFER_SIZE = 1024;
+
+SerialTxQueue<TX_QUEUE_SIZE> txQueue;
+CountLogger droppedFramesLogger("Pi serial TX queue full, dropped frames",
+                                1000);
+
+void init() {
+    Serial2.setTxBufferSize(UART_TX_BUFFER_SIZE);  // must be before begin
+    Serial2.begin(PI_BAUD, SERIAL_8N1, RX_PIN, TX_PIN);
+}
+
+void sendBatch() {
+    static uint8_t frame[MAX_FRAME_SIZE];
+    size_t frameSize =
+        frameWriter.write(batch.getPayload(), batch.getPayloadSize(), frame);
+    batch.clear();
 
+    // the Pi counts the dropped frames from the gap in sequence numbers, and
+    // tick() reports them
+    txQueue.push(frame, frameSize);
+}
+
+void addSample(int64_t ts, int32_t st1Counts, int32_t st2Counts) {
     // DB should store raw readings, not median
-    int32_t st1_host =
-        smallTransd1ADC.getLatestVolts() * SMALL_TRANSD_1_MPSI_PER_VOLT;
-    int32_t st2_host =
-        smallTransd2ADC.getLatestVolts() * SMALL_TRANSD_2_MPSI_PER_VOLT;
+    int32_t values[] = {smallTransd1ADC.toUnits(st1Counts),
+                        smallTransd2ADC.toUnits(st2Counts)};
 
-    // deal with endianness
-    uint64_t ts = htobe64(ts_host);
-    uint32_t st1 = htonl(st1_host);
-    uint32_t st2 = htonl(st2_host);
+    batch.add(ts, values);
+    if (batch.isFull()) {
+        sendBatch();
+    }
+}
 
-    Serial2.write((uint8_t *)&ts, sizeof(ts));    // 8 bytes
-    Serial2.write((uint8_t *)&st1, sizeof(st1));  // 4 bytes
-    Serial2.write((uint8_t *)&st2, sizeof(st2));  // 4 bytes
+void tick() {
+    if (!batch.isEmpty() &&
+        esp_timer_get_time() - batch.getFirstTs() >= BATCH_MAX_AGE_US) {
+        sendBatch();
+    }
 
-    Serial2.write(PACKET_DELIMITER, sizeof(PACKET_DELIMITER));
+    txQueue.tick(Serial2);
+    droppedFramesLogger.tick(txQueue.getDroppedFrameCount());
 }
 
 }  // namespace piSerial
@@ -103,12 +146,23 @@ namespace mainSerial {
 const int RX_PIN = 47;
 const int TX_PIN = 48;
 
-const int SENTENCE_INTERVAL = 50;
+// a frame per reading of small transducer 1 is about 30 bytes at 860 Hz
+const int BAUD = 921600;
 
+// commands from the main board are sentences
 const char *RECALIBRATE_SENTENCE = "cal";
 const char *CLEAR_CALIBRATION_SENTENCE = "clear cal";
 
-const char *CALIBRATION_COMPLETE_SENTENCE = "calibrated";
+// messages to the main board are packet_framing frames whose first payload
+// byte is the message type
+const uint8_t PRESSURES_MESSAGE = 1;
+const uint8_t CALIBRATED_MESSAGE = 2;
+
+// type, int64 ts, then int32 st1, st2 readings and st1, st2 medians in milli
+// psi, all big endian
+const size_t PRESSURES_PAYLOAD_SIZE = 1 + 8 + 4 * 4;
+
+const size_t TX_QUEUE_SIZE = 1024;
 
 void processCompletedSentence(const char *sentence) {
     std::string sentenceStr = sentence;
@@ -123,41 +177,71 @@ void processCompletedSentence(const char *sentence) {
     }
 }
 
-SentenceSerial serial(Serial1, processCompletedSentence);
-
-void sendSentence() {
-    // sentence format: <st1_pressure_mpsi_long st2_pressure_mpsi_long>
-    // ex: <123456 123456>
+SentenceSerial<> serial(Serial1, processCompletedSentence);
+packet_framing::FrameWriter frameWriter;
+SerialTxQueue<TX_QUEUE_SIZE> txQueue;
+CountLogger droppedFramesLogger("Main serial TX queue full, dropped frames",
+                                1000);
 
-    // send median readings to main board, as this gets displayed in the live UI
-    long st1 = smallTransd1ADC.getMedianVolts() * SMALL_TRANSD_1_MPSI_PER_VOLT;
-    long st2 = smallTransd2ADC.getMedianVolts() * SMALL_TRANSD_2_MPSI_PER_VOLT;
+void sendFrame(const uint8_t *payload, size_t size) {
+    uint8_t frame[packet_framing::maxFrameSize(PRESSURES_PAYLOAD_SIZE)];
+    size_t frameSize = frameWriter.write(payload, size, frame);
 
-    char sentence[64];
-    snprintf(sentence, sizeof(sentence), "%ld %ld", st1, st2);
+    // tick() reports dropped frames
+    txQueue.push(frame, frameSize);
+}
 
-    serial.sendSentence(sentence);
+void sendPressures(int64_t ts, int32_t st1Counts, int32_t st2Counts) {
+    uint8_t payload[PRESSURES_PAYLOAD_SIZE];
+    payload[0] = PRESSURES_MESSAGE;
+    packet_framing::putBigEndian(payload + 1, ts, 8);
+    packet_framing::putBigEndian(payload + 9,
+                                 smallTransd1ADC.toUnits(st1Counts), 4);
+    packet_framing::putBigEndian(payload + 13,
+                                 smallTransd2ADC.toUnits(st2Counts), 4);
+    // medians get displayed in the live UI and drive the fill sequence
+    packet_framing::putBigEndian(payload + 17,
+                                 smallTransd1ADC.getMedianUnits(), 4);
+    packet_framing::putBigEndian(payload + 21,
+                                 smallTransd2ADC.getMedianUnits(), 4);
+
+    sendFrame(payload, sizeof(payload));
 
     if (PRINT_DEBUG) {
-        Serial.print("Wrote sentence to main module: ");
-        Serial.println(sentence);
+        Serial.print("Wrote pressures to main module: ");
+        Serial.print(smallTransd1ADC.getMedianUnits());
+        Serial.print(" ");
+        Serial.println(smallTransd2ADC.getMedianUnits());
     }
 }
 
-TickTwo sentenceTicker(sendSentence, SENTENCE_INTERVAL);
-
-void init() {
-    serial.init(RX_PIN, TX_PIN);
-    sentenceTicker.start();
+void sendCalibrated() {
+    uint8_t payload[] = {CALIBRATED_MESSAGE};
+    sendFrame(payload, sizeof(payload));
 }
 
+void init() { serial.init(RX_PIN, TX_PIN, BAUD); }
+
 void tick() {
     serial.tick();
-    sentenceTicker.update();
+    txQueue.tick(serial);
+    droppedFramesLogger.tick(txQueue.getDroppedFrameCount());
 }
 
 }  // namespace mainSerial
 
+// Sends every reading of small transducer 1, one per conversion, to both
+// boards, timestamped with it and with the latest reading of small
+// transducer 2.
+void tickSamples() {
+    ADCSample sample;
+    while (smallTransd1ADC.popSample(sample)) {
+        int32_t st2Counts = smallTransd2ADC.getLatestCounts();
+        piSerial::addSample(sample.ts, sample.counts, st2Counts);
+        mainSerial::sendPressures(sample.ts, sample.counts, st2Counts);
+    }
+}
+
 void readCalibration() {
     uint32_t markerVal = EEPROM.readUInt(0);
     if (markerVal == EEPROM_WRITTEN_MARKER) {
@@ -168,21 +252,38 @@ void readCalibration() {
     }
 }
 
+// The ADCs collect their calibration readings in parallel from tick(), so
+// telemetry keeps flowing; tickRecalibration() saves the result.
 void recalibrate() {
-    float st1Zero = smallTransd1ADC.recalibrate(ADC_CALIBRATE_SAMPLE_COUNT);
-    float st2Zero = smallTransd2ADC.recalibrate(ADC_CALIBRATE_SAMPLE_COUNT);
+    smallTransd1ADC.startRecalibration();
+    smallTransd2ADC.startRecalibration();
+    recalibrating = true;
+
+    Serial.println("Recalibrating");
+}
+
+void tickRecalibration() {
+    if (!recalibrating || smallTransd1ADC.isRecalibrating() ||
+        smallTransd2ADC.isRecalibrating()) {
+        return;
+    }
+    recalibrating = false;
+
+    float st1Zero = smallTransd1ADC.getZeroVolts();
+    float st2Zero = smallTransd2ADC.getZeroVolts();
 
     EEPROM.writeUInt(0, EEPROM_WRITTEN_MARKER);
     EEPROM.writeFloat(SMALL_TRANSD_1_ZERO_EEPROM_ADDR, st1Zero);
     EEPROM.writeFloat(SMALL_TRANSD_2_ZERO_EEPROM_ADDR, st2Zero);
     EEPROM.commit();
 
-    mainSerial::serial.sendSentence(mainSerial::CALIBRATION_COMPLETE_SENTENCE);
+    mainSerial::sendCalibrated();
 
     Serial.println("Recalibrated and saved to EEPROM");
 }
 
 void clearCalibration() {
+    recalibrating = false;
     smallTransd1ADC.resetZero();
     smallTransd2ADC.resetZero();
 
@@ -215,9 +316,21 @@ void setup() {
             ;
     }
 
+    smallTransd1ADC.setUnitsPerVolt(SMALL_TRANSD_1_MPSI_PER_VOLT);
+    smallTransd2ADC.setUnitsPerVolt(SMALL_TRANSD_2_MPSI_PER_VOLT);
+
     smallTransd1ADC.enableContinuous();
     smallTransd2ADC.enableContinuous();
 
+    if (ADC1_ALERT_PIN >= 0) {
+        smallTransd1ADC.enableReadyInterrupt(ADC1_ALERT_PIN);
+    }
+    if (ADC2_ALERT_PIN >= 0) {
+        smallTransd2ADC.enableReadyInterrupt(ADC2_ALERT_PIN);
+    }
+
+    smallTransd1ADC.enableSampleQueue();
+
     EEPROM.begin(EEPROM_SIZE);
     readCalibration();
 
@@ -228,9 +341,11 @@ void setup() {
 void loop() {
     frequencyLogger.tick();
 
-    // read the ADCs and send sentences to the raspberry pi every tick
+    // read the ADCs and send their readings every tick
     smallTransd1ADC.tick();
     smallTransd2ADC.tick();
+    tickRecalibration();
+    tickSamples();
 
     piSerial::tick();
     mainSerial::tick();
@@ -0,0 +1,48 @@
+import struct
+
+# Decodes batches written by arduino_libraries/packet_framing/batch_encoder.h:
+# the first sample as a big endian int64 ts and int32 values, then every next
+# sample as a LEB128 varint ts delta and zigzag varint value deltas.
+
+
+def _read_varint(data: bytes, i: int) -> tuple[int, int]:
+    value = 0
+    shift = 0
+
+    while True:
+        if i >= len(data):
+            raise ValueError("Batch ends in the middle of a varint")
+        byte = data[i]
+        i += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, i
+
+
+def decode(payload: bytes, channel_count: int) -> list[tuple[int, list[int]]]:
+    """
+    returns (ts, values) for every sample in the batch, or throws an exception
+    if the payload is malformed
+    """
+
+    first_format = f"!q{channel_count}i"
+    first_size = struct.calcsize(first_format)
+    if len(payload) < first_size:
+        raise ValueError(
+            f"Expected batch length of at least {first_size}, got {len(payload)}"
+        )
+
+    ts, *values = struct.unpack(first_format, payload[:first_size])
+    samples = [(ts, list(values))]
+
+    i = first_size
+    while i < len(payload):
+        ts_delta, i = _read_varint(payload, i)
+        ts += ts_delta
+        for c in range(channel_count):
+            zigzag, i = _read_varint(payload, i)
+            values[c] += (zigzag >> 1) ^ -(zigzag & 1)
+        samples.append((ts, list(values)))
+
+    return samples
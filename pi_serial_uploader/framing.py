@@ -0,0 +1,69 @@
+import binascii
+import sys
+
+# Decodes frames written by arduino_libraries/packet_framing, which are
+# COBS(seq payload crc) followed by a 0x00 delimiter, with a big endian 16 bit
+# sequence number and CRC-16/CCITT-FALSE.
+
+delimiter = b"\x00"
+
+
+def cobs_decode(data: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ValueError("Invalid COBS data")
+
+        out += data[i : i + code - 1]
+        i += code - 1
+        # the last block has no implied zero after it
+        if code != 0xFF and i < len(data):
+            out.append(0)
+
+    return bytes(out)
+
+
+def crc16(data: bytes) -> int:
+    # crc_hqx is CRC-16/CCITT-FALSE when started at 0xFFFF
+    return binascii.crc_hqx(data, 0xFFFF)
+
+
+class Deframer:
+    """
+    Checks and unwraps frames, counting frames lost according to their
+    sequence numbers.
+    """
+
+    def __init__(self):
+        self.next_seq: int | None = None
+        self.lost_frames = 0
+
+    def deframe(self, frame: bytes) -> bytes:
+        """
+        frame: a frame without its delimiter
+        returns the payload, or throws an exception if the frame is corrupt
+        """
+
+        decoded = cobs_decode(frame)
+        if len(decoded) < 4:
+            raise ValueError(f"Frame too short ({len(decoded)} bytes)")
+
+        body, crc = decoded[:-2], int.from_bytes(decoded[-2:], "big")
+        if crc16(body) != crc:
+            raise ValueError("Frame failed CRC")
+
+        seq = int.from_bytes(body[:2], "big")
+        if self.next_seq is not None and seq != self.next_seq:
+            lost = (seq - self.next_seq) & 0xFFFF
+            self.lost_frames += lost
+            print(
+                f"Lost {lost} frames ({self.lost_frames} total)",
+                file=sys.stderr,
+            )
+        self.next_seq = (seq + 1) & 0xFFFF
+
+        return body[2:]
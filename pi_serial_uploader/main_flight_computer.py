@@ -1,8 +1,9 @@
+import framing
 import uploader
 import struct
 import json
 
-delimiter = b"\xAA\x55"  # {0b10101010, 0b01010101}
+deframer = framing.Deframer()
 
 
 def parse_device(packet: bytes) -> str:
@@ -35,4 +36,9 @@ def parse_packet(packet: bytes) -> str:
     raise ValueError(f"Expected packet length 16 or 20, got {len(packet)}")
 
 
-uploader.run(parse_device, delimiter, parse_packet)
+uploader.run(
+    parse_device,
+    framing.delimiter,
+    parse_packet,
+    deframe=deframer.deframe,
+)
@@ -1,21 +1,22 @@
+import batch
+import framing
 import uploader
-import struct
 import json
 
-delimiter = b"\xAA\x55"  # {0b10101010, 0b01010101}
+deframer = framing.Deframer()
 
 
-def parse_packet(packet: bytes) -> str:
-    if len(packet) == 16:
-        # breakdown of "!qii":
-        #   "!": network byte order
-        #   "q": long long
-        #   "i": int
-        ts, st1, st2 = struct.unpack("!qii", packet)
-        data = {"ts": ts, "st1": st1, "st2": st2}
-        return json.dumps(data)
+def parse_packet(packet: bytes) -> list[str]:
+    # a batch of samples of the 2 small transducers
+    return [
+        json.dumps({"ts": ts, "st1": st1, "st2": st2})
+        for ts, (st1, st2) in batch.decode(packet, 2)
+    ]
 
-    raise ValueError(f"Expected packet length 16, got {len(packet)}")
 
-
-uploader.run("Scientific", delimiter, parse_packet)
+uploader.run(
+    "Scientific",
+    framing.delimiter,
+    parse_packet,
+    deframe=deframer.deframe,
+)
@@ -0,0 +1,168 @@
+// Encodes frames and batches with arduino_libraries/packet_framing, exactly as
+// the boards do, and prints them for test_framing.py to decode. One case per
+// line, bytes in hex, "-" for no bytes:
+//
+//   frame <payload> <frame>       consecutive frames from one FrameWriter
+//   crc_error <frame>             valid COBS, but the CRC doesn't match
+//   lost <count> <frame>...       frames with `count` missing between them
+//   batch <channels> <samples> <frame>
+//
+// where <samples> is ts:value:value...,ts:value:value...
+
+#include <batch_encoder.h>
+#include <packet_framing.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+using namespace packet_framing;
+
+typedef std::vector<uint8_t> Bytes;
+
+void printHex(const Bytes& bytes) {
+    printf(" ");
+    if (bytes.empty()) {
+        printf("-");
+    }
+    for (uint8_t byte : bytes) {
+        printf("%02x", byte);
+    }
+}
+
+// without the delimiter, as the Pi gets it from read_until()
+Bytes writeFrame(FrameWriter& writer, const Bytes& payload) {
+    Bytes frame(maxFrameSize(payload.size()));
+    size_t size = writer.write(payload.data(), payload.size(), frame.data());
+    if (size > frame.size() || frame[size - 1] != FRAME_DELIMITER) {
+        fprintf(stderr, "bad frame for a %zu byte payload\n", payload.size());
+        exit(1);
+    }
+    frame.resize(size - 1);
+    return frame;
+}
+
+void printFrames() {
+    FrameWriter writer;
+
+    auto print = [&](const Bytes& payload) {
+        printf("frame");
+        printHex(payload);
+        printHex(writeFrame(writer, payload));
+        printf("\n");
+    };
+
+    // no zeros, across the 254 byte COBS block boundary several times, first
+    // with a zero in the sequence number and then, past seq 0x0101, without
+    for (size_t size = 0; size <= 600; size++) {
+        print(Bytes(size, 0x01 + size % 0xFF));
+    }
+
+    // only zeros
+    for (size_t size = 1; size <= 4; size++) {
+        print(Bytes(size, 0x00));
+    }
+
+    // a zero right before, at and after each block boundary
+    for (size_t zeroAt = 248; zeroAt <= 260; zeroAt++) {
+        Bytes payload(520, 0xFF);
+        payload[zeroAt] = 0;
+        payload[zeroAt + 254] = 0;
+        print(payload);
+    }
+}
+
+void printCrcError() {
+    FrameWriter writer;
+    Bytes frame = writeFrame(writer, Bytes{1, 2, 3, 4});
+
+    // corrupt a payload byte, then encode again so only the CRC can tell
+    Bytes decoded(frame.size());
+    decoded.resize(cobsDecode(frame.data(), frame.size(), decoded.data()));
+    decoded[3] ^= 0x10;
+
+    Bytes corrupt(frame.size() + 1);
+    CobsEncoder encoder(corrupt.data());
+    encoder.put(decoded.data(), decoded.size());
+    corrupt.resize(encoder.finish());
+
+    printf("crc_error");
+    printHex(corrupt);
+    printf("\n");
+}
+
+void printLost() {
+    FrameWriter writer;
+    Bytes first = writeFrame(writer, Bytes{1});
+    writeFrame(writer, Bytes{2});
+    writeFrame(writer, Bytes{3});
+    Bytes last = writeFrame(writer, Bytes{4});
+
+    printf("lost 2");
+    printHex(first);
+    printHex(last);
+    printf("\n");
+}
+
+template <int ChannelCount, int MaxSamples>
+void printBatch(const std::vector<std::vector<int64_t>>& samples) {
+    BatchEncoder<ChannelCount, MaxSamples> batch;
+    for (const std::vector<int64_t>& sample : samples) {
+        int32_t values[ChannelCount];
+        for (int i = 0; i < ChannelCount; i++) {
+            values[i] = sample[i + 1];
+        }
+        if (!batch.add(sample[0], values)) {
+            fprintf(stderr, "batch full\n");
+            exit(1);
+        }
+    }
+
+    FrameWriter writer;
+    Bytes payload(batch.getPayload(),
+                  batch.getPayload() + batch.getPayloadSize());
+
+    printf("batch %d ", ChannelCount);
+    for (size_t s = 0; s < samples.size(); s++) {
+        for (size_t i = 0; i < samples[s].size(); i++) {
+            printf(i == 0 ? "%lld" : ":%lld", (long long)samples[s][i]);
+        }
+        printf(s + 1 < samples.size() ? "," : "");
+    }
+    printHex(writeFrame(writer, payload));
+    printf("\n");
+}
+
+void printBatches() {
+    // one sample is laid out like a plain packet
+    printBatch<3, 16>({{1000, 1, -2, 3}});
+
+    // small negative and positive deltas, as from a noisy transducer
+    printBatch<3, 16>({{5000000, 750000, 0, -1},
+                       {5001163, 749990, -1, -2},
+                       {5002326, 750010, 1, 0},
+                       {5003489, 749000, -64, 63},
+                       {5004652, 749000, 64, -65},
+                       {5004652, 0, -8192, 8191}});
+
+    // the largest deltas, and ts deltas of 0 and 2^40
+    printBatch<2, 16>({{-5, INT32_MAX, INT32_MIN},
+                       {-5, INT32_MIN, INT32_MAX},
+                       {(1LL << 40) - 5, INT32_MAX, INT32_MIN},
+                       {(1LL << 40) - 5, 0, 0}});
+
+    // a full batch of a single channel
+    std::vector<std::vector<int64_t>> samples;
+    for (int i = 0; i < 16; i++) {
+        samples.push_back({i * 1163LL, (i % 2 ? -1 : 1) * i * 1000});
+    }
+    printBatch<1, 16>(samples);
+}
+
+int main() {
+    printFrames();
+    printCrcError();
+    printLost();
+    printBatches();
+    return 0;
+}
@@ -0,0 +1,124 @@
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+# Round trips between the boards and the Pi: encode_fixtures.cpp encodes with
+# arduino_libraries/packet_framing, and framing.py and batch.py must decode
+# exactly what went in. Needs g++. Run from pi_serial_uploader with
+#
+#   python3 -m unittest discover tests
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.dirname(TESTS_DIR))
+
+import batch  # noqa: E402
+import framing  # noqa: E402
+
+PACKET_FRAMING_DIR = os.path.join(
+    TESTS_DIR, "..", "..", "arduino_libraries", "packet_framing"
+)
+
+
+def parse_hex(text: str) -> bytes:
+    return b"" if text == "-" else bytes.fromhex(text)
+
+
+def encode_fixtures() -> list[list[str]]:
+    if shutil.which("g++") is None:
+        raise unittest.SkipTest("g++ is needed to build encode_fixtures.cpp")
+
+    with tempfile.TemporaryDirectory() as build_dir:
+        binary = os.path.join(build_dir, "encode_fixtures")
+        subprocess.run(
+            [
+                "g++",
+                "-std=c++11",
+                "-Wall",
+                "-I" + PACKET_FRAMING_DIR,
+                os.path.join(TESTS_DIR, "encode_fixtures.cpp"),
+                "-o",
+                binary,
+            ],
+            check=True,
+        )
+        output = subprocess.run(
+            [binary], check=True, capture_output=True, text=True
+        ).stdout
+
+    return [line.split(" ") for line in output.splitlines()]
+
+
+class FramingTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.fixtures = encode_fixtures()
+
+    def cases(self, kind: str) -> list[list[str]]:
+        cases = [args for name, *args in self.fixtures if name == kind]
+        self.assertGreater(len(cases), 0)
+        return cases
+
+    def test_frames(self):
+        deframer = framing.Deframer()
+
+        for payload_hex, frame_hex in self.cases("frame"):
+            payload = parse_hex(payload_hex)
+            frame = parse_hex(frame_hex)
+            with self.subTest(size=len(payload)):
+                self.assertNotIn(framing.delimiter, frame)
+                self.assertEqual(deframer.deframe(frame), payload)
+
+        self.assertEqual(deframer.lost_frames, 0)
+
+    def test_empty_payload(self):
+        payload_hex, frame_hex = self.cases("frame")[0]
+        self.assertEqual(payload_hex, "-")
+        self.assertEqual(framing.Deframer().deframe(parse_hex(frame_hex)), b"")
+
+    def test_empty_frame(self):
+        # two delimiters in a row, e.g. after a resync
+        with self.assertRaises(ValueError):
+            framing.Deframer().deframe(b"")
+
+    def test_crc_error(self):
+        (frame_hex,) = self.cases("crc_error")[0]
+        with self.assertRaisesRegex(ValueError, "CRC"):
+            framing.Deframer().deframe(parse_hex(frame_hex))
+
+    def test_truncated_frame(self):
+        _, frame_hex = self.cases("frame")[300]
+        with self.assertRaises(ValueError):
+            framing.Deframer().deframe(parse_hex(frame_hex)[:-1])
+
+    def test_lost_frames(self):
+        count, *frames = self.cases("lost")[0]
+        deframer = framing.Deframer()
+        for frame_hex in frames:
+            deframer.deframe(parse_hex(frame_hex))
+        self.assertEqual(deframer.lost_frames, int(count))
+
+    def test_batches(self):
+        for channel_count, samples_text, frame_hex in self.cases("batch"):
+            expected = []
+            for sample in samples_text.split(","):
+                ts, *values = [int(x) for x in sample.split(":")]
+                expected.append((ts, values))
+
+            with self.subTest(samples=samples_text):
+                payload = framing.Deframer().deframe(parse_hex(frame_hex))
+                self.assertEqual(
+                    batch.decode(payload, int(channel_count)), expected
+                )
+
+    def test_truncated_batch(self):
+        _, _, frame_hex = self.cases("batch")[1]
+        payload = framing.Deframer().deframe(parse_hex(frame_hex))
+        with self.assertRaises(ValueError):
+            batch.decode(payload[:5], 3)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -123,16 +123,18 @@ def run_poll_messages(device: str, format_message: Callable[[Any], bytes]):
 def run(
     parse_device: str | Callable[[bytes], str],
     delimiter: bytes = b"\n",
-    parse_packet: Callable[[bytes], str] = lambda x: x.decode("utf-8"),
+    parse_packet: Callable[[bytes], str | list[str]] = lambda x: x.decode("utf-8"),
     format_message: Callable[[Any], bytes] | None = None,
+    deframe: Callable[[bytes], bytes] = lambda x: x,
 ):
     """
     Continuously read from serial port and send data to server.
 
     parse_device: device name to send to server, or function that takes a serial packet and returns a device name (and throws an exception if it fails)
     delimiter: delimiter between serial packets
-    parse_packet: function to parse a serial packet into json (and throws an exception if it fails)
+    parse_packet: function to parse a serial packet into json, or a list of json for a packet holding several records (and throws an exception if it fails)
     format_message: function that converts a message object into bytes to send to the serial port; set to None to disable polling messages; also requires parse_device to be a str
+    deframe: function that checks a serial packet and unwraps it before it is parsed (and throws an exception if it fails), e.g. framing.Deframer().deframe
     """
 
     # throw away possibly partial packet
@@ -159,6 +161,7 @@ def run(
             input_packet = input_packet[: -len(delimiter)]
 
             try:
+                input_packet = deframe(input_packet)
                 device = (
                     parse_device(input_packet)
                     if callable(parse_device)
@@ -173,28 +176,32 @@ def run(
                 )
                 continue
 
-            if records_count >= MAX_RECORDS_PER_BATCH:
-                continue
-
-            try:
-                data = json.loads(input_parsed)
-            except json.JSONDecodeError:
-                print(
-                    f"Error parsing input json: {input_parsed}",
-                    file=sys.stderr,
+            if not isinstance(input_parsed, list):
+                input_parsed = [input_parsed]
+
+            for input_json in input_parsed:
+                if records_count >= MAX_RECORDS_PER_BATCH:
+                    break
+
+                try:
+                    data = json.loads(input_json)
+                except json.JSONDecodeError:
+                    print(
+                        f"Error parsing input json: {input_json}",
+                        file=sys.stderr,
+                    )
+                    continue
+
+                if device not in records_dict:
+                    records_dict[device] = []
+
+                records_dict[device].append(
+                    {
+                        "ts": time.time_ns() // 1000,
+                        "data": data,
+                    }
                 )
-                continue
-
-            if device not in records_dict:
-                records_dict[device] = []
-
-            records_dict[device].append(
-                {
-                    "ts": time.time_ns() // 1000,
-                    "data": data,
-                }
-            )
-            records_count += 1
+                records_count += 1
 
         for device, records in records_dict.items():
             post_thread = Thread(target=post_records, args=(device, records))
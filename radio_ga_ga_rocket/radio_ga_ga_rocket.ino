@@ -33,6 +33,9 @@ RadioPacket packet = {
     .gps_altitude = 0,
 };
 
+// version of the polled records last copied into the packet
+uint32_t recordsVersion = 0;
+
 void printGpsTs() {
     Serial.print("GPS ts_tail: ");
     Serial.println(packet.gps_ts_tail);
@@ -64,19 +67,22 @@ void setup() {
 }
 
 void loop() {
-    rockets_client::StaticJsonDoc records = rockets_client::getLatestRecords();
-    JsonObject gps = records["GPS"]["data"];
-
-    packet.gps_ts_tail = gps["ts_tail"];
-    packet.gps_fix = gps["fix"];
-
-    if (packet.gps_fix) {
-        packet.gps_fixquality = gps["fixquality"];
-        packet.gps_satellites = gps["satellites"];
-        packet.gps_latitude_fixed = gps["latitude_fixed"];
-        packet.gps_longitude_fixed = gps["longitude_fixed"];
-        packet.gps_altitude = gps["altitude"];
-    }
+    // only touch the packet when a new poll has come in
+    rockets_client::borrowLatestRecords(
+        recordsVersion, [](const rockets_client::StaticJsonDoc& records) {
+            JsonObjectConst gps = records["GPS"]["data"];
+
+            packet.gps_ts_tail = gps["ts_tail"];
+            packet.gps_fix = gps["fix"];
+
+            if (packet.gps_fix) {
+                packet.gps_fixquality = gps["fixquality"];
+                packet.gps_satellites = gps["satellites"];
+                packet.gps_latitude_fixed = gps["latitude_fixed"];
+                packet.gps_longitude_fixed = gps["longitude_fixed"];
+                packet.gps_altitude = gps["altitude"];
+            }
+        });
 
     rf95.send((uint8_t*)&packet, sizeof(packet));
     rf95.waitPacketSent();
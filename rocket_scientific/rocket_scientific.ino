@@ -1,10 +1,13 @@
 #include <EEPROM.h>
 #include <TickTwo.h>
-#include <endian.h>
 
+#include "batch_encoder.h"
+#include "filters.h"
 #include "frequency_logger.h"
 #include "moving_median_adc.h"
+#include "packet_framing.h"
 #include "sentence_serial.h"
+#include "serial_tx_queue.h"
 
 const bool PRINT_DEBUG = false;
 
@@ -31,6 +34,11 @@ const int BUS1_SCL_PIN = 9;
 const int BUS2_SDA_PIN = 14;
 const int BUS2_SCL_PIN = 15;
 
+// each bus is sampled by its own task, away from the loop task's core
+const int BUS_TASK_CORE = 0;
+const int BUS_TASK_PRIORITY = 1;
+const int BUS_TASK_STACK_DEPTH = 4 * 1000;
+
 // shared ADC constants
 
 const int ADC_CALIBRATE_SAMPLE_COUNT = 500;
@@ -50,6 +58,12 @@ const adsGain_t ADC1_GAIN = GAIN_ONE;
 const adsGain_t ADC2_GAIN = GAIN_ONE;
 const adsGain_t ADC3_GAIN = GAIN_ONE;
 
+// GPIOs wired to the ALERT/RDY pins, or -1 if not wired, in which case the ADC
+// is polled at its data rate
+const int ADC1_ALERT_PIN = -1;
+const int ADC2_ALERT_PIN = -1;
+const int ADC3_ALERT_PIN = -1;
+
 // device constants
 
 const ADCMode TRANSD_1_ADC_MODE = ADCMode::SingleEnded_0;
@@ -60,21 +74,52 @@ const float TRANSD_1_MPSI_PER_VOLT = 1000 / 0.00341944869;
 const float TRANSD_2_MPSI_PER_VOLT = 1000 / 0.00341944869;
 const float TRANSD_3_MPSI_PER_VOLT = 1000000;
 
+// filters for the readings sent to the pi, in ADC counts
+// transducer 1 clocks the packets, so only its filter decimates, and the
+// average in front of the decimator is as long as the decimation factor to
+// anti-alias
+const int PI_MEDIAN_WINDOW_SIZE = 3;  // drops single-sample spikes
+const int PI_DECIMATION_FACTOR = 2;
+
+typedef filters::FilterChain<
+    int32_t, filters::MedianFilter<int32_t, PI_MEDIAN_WINDOW_SIZE>,
+    filters::MovingAverageFilter<int32_t, PI_DECIMATION_FACTOR, int64_t>,
+    filters::DecimationFilter<int32_t, PI_DECIMATION_FACTOR>>
+    Transd1PiFilter;
+typedef filters::FilterChain<
+    int32_t, filters::MedianFilter<int32_t, PI_MEDIAN_WINDOW_SIZE>,
+    filters::MovingAverageFilter<int32_t, PI_DECIMATION_FACTOR, int64_t>>
+    TransdPiFilter;
+
 // globals
 
 Adafruit_ADS1115 adc1;
 Adafruit_ADS1115 adc2;
 Adafruit_ADS1115 adc3;
 
-MovingMedianADC<Adafruit_ADS1115> Transd1ADC("transducer 1",
-                                             ADC_MEDIAN_WINDOW_SIZE, adc1,
-                                             TRANSD_1_ADC_MODE);
-MovingMedianADC<Adafruit_ADS1115> Transd2ADC("transducer 2",
-                                             ADC_MEDIAN_WINDOW_SIZE, adc2,
-                                             TRANSD_2_ADC_MODE);
-MovingMedianADC<Adafruit_ADS1115> Transd3ADC("transducer 3",
-                                             ADC_MEDIAN_WINDOW_SIZE, adc3,
-                                             TRANSD_3_ADC_MODE);
+typedef MovingMedianADC<Adafruit_ADS1115, ADC_MEDIAN_WINDOW_SIZE,
+                        ADC_CALIBRATE_SAMPLE_COUNT>
+    TransducerADC;
+
+TransducerADC Transd1ADC("transducer 1", adc1, TRANSD_1_ADC_MODE);
+TransducerADC Transd2ADC("transducer 2", adc2, TRANSD_2_ADC_MODE);
+TransducerADC Transd3ADC("transducer 3", adc3, TRANSD_3_ADC_MODE);
+
+// I2C buses, each sampled by its own task
+struct Bus {
+    const char *name;
+    TransducerADC *adcs[2];
+    int adcCount;
+    // held while the ADCs are ticked; the loop task must take it before
+    // touching their zero or calibration
+    SemaphoreHandle_t mutex;
+};
+
+Bus bus1 = {.name = "bus 1", .adcs = {&Transd1ADC, &Transd2ADC}, .adcCount = 2};
+Bus bus2 = {.name = "bus 2", .adcs = {&Transd3ADC}, .adcCount = 1};
+
+// true from a recalibrate command until every ADC has its new zero
+bool recalibrating = false;
 
 void recalibrate();
 void clearCalibration();
@@ -86,9 +131,6 @@ namespace piSerial {
 const int RX_PIN = 18;
 const int TX_PIN = 17;
 
-// worst case, the delimiter occurs in the data, in which case we drop a packet
-uint8_t PACKET_DELIMITER[] = {0b10101010, 0b01010101};
-
 const char *RECALIBRATE_SENTENCE = "cal";
 const char *CLEAR_CALIBRATION_SENTENCE = "clear cal";
 
@@ -105,45 +147,159 @@ void processCompletedSentence(const char *sentence) {
     }
 }
 
-SentenceSerial serial(Serial2, processCompletedSentence);
+SentenceSerial<> serial(Serial2, processCompletedSentence);
 
-void init() { serial.init(RX_PIN, TX_PIN, PI_BAUD); }
+// frames waiting for the UART, so sampling never waits on the serial; about
+// 180ms of data at PI_BAUD, on top of the UART driver's own TX buffer
+const size_t TX_QUEUE_SIZE = 4096;
+const size_t UART_TX_BUFFER_SIZE = 1024;
 
-void tick() {
-    serial.tick();
+SerialTxQueue<TX_QUEUE_SIZE> txQueue;
+CountLogger droppedFramesLogger("Pi serial TX queue full, dropped frames",
+                                1000);
 
-    int64_t ts_host = esp_timer_get_time();
+void init() {
+    Serial2.setTxBufferSize(UART_TX_BUFFER_SIZE);  // must be before begin
+    serial.init(RX_PIN, TX_PIN, PI_BAUD);
+}
 
-    // DB should store raw readings, not median
-    int32_t t1_host = Transd1ADC.getLatestVolts() * TRANSD_1_MPSI_PER_VOLT;
-    int32_t t2_host = Transd2ADC.getLatestVolts() * TRANSD_2_MPSI_PER_VOLT;
-    int32_t t3_host = Transd3ADC.getLatestVolts() * TRANSD_3_MPSI_PER_VOLT;
+// samples per frame; each frame is sent once full, or once its first sample
+// is PI_BATCH_MAX_AGE_US old
+const int PI_BATCH_SIZE = 16;
+const int64_t PI_BATCH_MAX_AGE_US = 100 * 1000;
+
+typedef BatchEncoder<3, PI_BATCH_SIZE> PiBatch;
+const size_t MAX_FRAME_SIZE =
+    packet_framing::maxFrameSize(PiBatch::MAX_PAYLOAD_SIZE);
+
+PiBatch batch;
+packet_framing::FrameWriter frameWriter;
+
+Transd1PiFilter t1Filter;
+TransdPiFilter t2Filter;
+TransdPiFilter t3Filter;
+
+// latest filtered readings of the transducers that don't clock the packets, as
+// of the transducer 1 reading being sent
+int32_t latestT2Counts = 0;
+int32_t latestT3Counts = 0;
+
+// Runs the readings `adc` queued up to `ts` through `filter`, leaving later
+// ones queued, so `latestCounts` is its latest output at or before `ts`.
+// Readings from before a recalibration are relative to the old zero, so the
+// filter restarts at the first reading after it.
+void filterUpTo(TransducerADC &adc, TransdPiFilter &filter,
+                int32_t &latestCounts, int64_t ts) {
+    ADCSample sample;
+    while (adc.peekSample(sample) && sample.ts <= ts) {
+        adc.popSample(sample);
+        if (sample.zeroChanged) {
+            filter.reset(sample.counts);
+        }
+        filter.process(sample.counts, latestCounts);
+    }
+}
 
-    // deal with endianness
-    uint64_t ts = htobe64(ts_host);
-    uint32_t t1 = htonl(t1_host);
-    uint32_t t2 = htonl(t2_host);
-    uint32_t t3 = htonl(t3_host);
+void sendBatch() {
+    static uint8_t frame[MAX_FRAME_SIZE];
+    size_t frameSize =
+        frameWriter.write(batch.getPayload(), batch.getPayloadSize(), frame);
+    batch.clear();
 
-    serial.write((uint8_t *)&ts, sizeof(ts));  // 8 bytes
-    serial.write((uint8_t *)&t1, sizeof(t1));  // 4 bytes
-    serial.write((uint8_t *)&t2, sizeof(t2));  // 4 bytes
-    serial.write((uint8_t *)&t3, sizeof(t3));  // 4 bytes
+    // the Pi counts the dropped frames from the gap in sequence numbers, and
+    // tick() reports them
+    txQueue.push(frame, frameSize);
+}
 
-    serial.write(PACKET_DELIMITER, sizeof(PACKET_DELIMITER));
+void addSample(int64_t ts, int32_t t1Counts, int32_t t2Counts,
+               int32_t t3Counts) {
+    int32_t values[] = {Transd1ADC.toUnits(t1Counts),
+                        Transd2ADC.toUnits(t2Counts),
+                        Transd3ADC.toUnits(t3Counts)};
 
     if (PRINT_DEBUG) {
         Serial.print("t1: ");
-        Serial.print(t1_host);
+        Serial.print(values[0]);
         Serial.print("\tt2: ");
-        Serial.println(t2_host);
+        Serial.println(values[1]);
         Serial.print("\tt3: ");
-        Serial.println(t3_host);
+        Serial.println(values[2]);
+    }
+
+    batch.add(ts, values);
+    if (batch.isFull()) {
+        sendBatch();
     }
 }
 
+void tick() {
+    serial.tick();
+
+    // one sample per output of transducer 1's filter, which is one per
+    // PI_DECIMATION_FACTOR conversions, timestamped with the last of them
+    ADCSample sample;
+    while (Transd1ADC.popSample(sample)) {
+        // the other transducers as they were at the time
+        filterUpTo(Transd2ADC, t2Filter, latestT2Counts, sample.ts);
+        filterUpTo(Transd3ADC, t3Filter, latestT3Counts, sample.ts);
+
+        if (sample.zeroChanged) {
+            t1Filter.reset(sample.counts);
+        }
+        int32_t t1Counts;
+        if (t1Filter.process(sample.counts, t1Counts)) {
+            addSample(sample.ts, t1Counts, latestT2Counts, latestT3Counts);
+        }
+    }
+
+    if (!batch.isEmpty() &&
+        esp_timer_get_time() - batch.getFirstTs() >= PI_BATCH_MAX_AGE_US) {
+        sendBatch();
+    }
+
+    txQueue.tick(serial);
+    droppedFramesLogger.tick(txQueue.getDroppedFrameCount());
+}
+
 }  // namespace piSerial
 
+void lockBuses() {
+    // always in the same order
+    xSemaphoreTake(bus1.mutex, portMAX_DELAY);
+    xSemaphoreTake(bus2.mutex, portMAX_DELAY);
+}
+
+void unlockBuses() {
+    xSemaphoreGive(bus2.mutex);
+    xSemaphoreGive(bus1.mutex);
+}
+
+void busTask(void *pvParameters) {
+    Bus &bus = *(Bus *)pvParameters;
+    FrequencyLogger frequencyLogger(bus.name, 1000);
+
+    while (true) {
+        frequencyLogger.tick();
+
+        xSemaphoreTake(bus.mutex, portMAX_DELAY);
+        for (int i = 0; i < bus.adcCount; i++) {
+            bus.adcs[i]->tick();
+        }
+        xSemaphoreGive(bus.mutex);
+
+        // one tick is about one conversion at 860 SPS; also lets the idle
+        // task run
+        delay(1);
+    }
+}
+
+void startBusTask(Bus &bus) {
+    bus.mutex = xSemaphoreCreateMutex();
+    xTaskCreatePinnedToCore(busTask, bus.name, BUS_TASK_STACK_DEPTH, &bus,
+                            BUS_TASK_PRIORITY, NULL, BUS_TASK_CORE);
+}
+
+// only called before the bus tasks start
 void readCalibration() {
     uint32_t markerVal = EEPROM.readUInt(0);
     if (markerVal == EEPROM_WRITTEN_MARKER) {
@@ -153,10 +309,36 @@ void readCalibration() {
     }
 }
 
+// The ADCs collect their calibration readings in parallel from tick(), so
+// telemetry keeps flowing; tickRecalibration() saves the result.
 void recalibrate() {
-    float t1Zero = Transd1ADC.recalibrate(ADC_CALIBRATE_SAMPLE_COUNT);
-    float t2Zero = Transd2ADC.recalibrate(ADC_CALIBRATE_SAMPLE_COUNT);
-    float t3Zero = Transd3ADC.recalibrate(ADC_CALIBRATE_SAMPLE_COUNT);
+    lockBuses();
+    Transd1ADC.startRecalibration();
+    Transd2ADC.startRecalibration();
+    Transd3ADC.startRecalibration();
+    unlockBuses();
+    recalibrating = true;
+
+    Serial.println("Recalibrating");
+}
+
+void tickRecalibration() {
+    if (!recalibrating) {
+        return;
+    }
+
+    lockBuses();
+    bool done = !Transd1ADC.isRecalibrating() &&
+                !Transd2ADC.isRecalibrating() && !Transd3ADC.isRecalibrating();
+    float t1Zero = Transd1ADC.getZeroVolts();
+    float t2Zero = Transd2ADC.getZeroVolts();
+    float t3Zero = Transd3ADC.getZeroVolts();
+    unlockBuses();
+
+    if (!done) {
+        return;
+    }
+    recalibrating = false;
 
     EEPROM.writeUInt(0, EEPROM_WRITTEN_MARKER);
     EEPROM.writeFloat(TRANSD_1_ZERO_EEPROM_ADDR, t1Zero);
@@ -168,9 +350,12 @@ void recalibrate() {
 }
 
 void clearCalibration() {
+    recalibrating = false;
+    lockBuses();
     Transd1ADC.resetZero();
     Transd2ADC.resetZero();
     Transd3ADC.resetZero();
+    unlockBuses();
 
     EEPROM.writeUInt(0, 0x00000000);
     EEPROM.commit();
@@ -209,23 +394,41 @@ void setup() {
         while (1);
     }
 
+    Transd1ADC.setUnitsPerVolt(TRANSD_1_MPSI_PER_VOLT);
+    Transd2ADC.setUnitsPerVolt(TRANSD_2_MPSI_PER_VOLT);
+    Transd3ADC.setUnitsPerVolt(TRANSD_3_MPSI_PER_VOLT);
+
     Transd1ADC.enableContinuous();
     Transd2ADC.enableContinuous();
     Transd3ADC.enableContinuous();
 
+    if (ADC1_ALERT_PIN >= 0) {
+        Transd1ADC.enableReadyInterrupt(ADC1_ALERT_PIN);
+    }
+    if (ADC2_ALERT_PIN >= 0) {
+        Transd2ADC.enableReadyInterrupt(ADC2_ALERT_PIN);
+    }
+    if (ADC3_ALERT_PIN >= 0) {
+        Transd3ADC.enableReadyInterrupt(ADC3_ALERT_PIN);
+    }
+
+    Transd1ADC.enableSampleQueue();
+    Transd2ADC.enableSampleQueue();
+    Transd3ADC.enableSampleQueue();
+
     EEPROM.begin(EEPROM_SIZE);
     readCalibration();
 
     piSerial::init();
+
+    startBusTask(bus1);
+    startBusTask(bus2);
 }
 
 void loop() {
     frequencyLogger.tick();
 
-    // read the ADCs and send sentences to the raspberry pi every tick
-    Transd1ADC.tick();
-    Transd2ADC.tick();
-    Transd3ADC.tick();
-
+    // the bus tasks read the ADCs; send their readings to the raspberry pi
+    tickRecalibration();
     piSerial::tick();
 }